@@ -0,0 +1,118 @@
+#include <QCoreApplication>
+
+#include "bench.h"
+#include "../xn-engine-thread.h"
+#include "../lib-api.h"
+
+/* C-ABI overhead benchmarks: lib-api.cpp wraps each LibStdCallback into
+ * heap-allocated Cb lambdas (& posts the call to EngineThread). lib-api.cpp
+ * requires the GUI library, so its call pattern is replicated here. Each
+ * operation is acknowledged by the LI, so callbacks are called too.
+ *
+ * EngineThread is measured both not started (tasks executed inline) and
+ * started as in the default DLL configuration (engineThread=true): task
+ * posted to the engine thread, callback passed back through the host queue. */
+
+namespace Xn {
+
+static size_t apiCallbacks = 0;
+
+static void CALL_CONV apiCallback(void *, void *) { apiCallbacks++; }
+
+static void callEv(void *sender, const LibStdCallback &callback) {
+	if (nullptr != callback.func)
+		callback.func(sender, callback.data);
+}
+
+// Host thread waits for 'count' callbacks, events of the host queue are delivered meanwhile
+static void waitCallbacks(size_t count) {
+	while (apiCallbacks < count)
+		QCoreApplication::processEvents();
+}
+
+static void benchApiEngineThread(const LibStdCallback &ok, const LibStdCallback &err) {
+	static const uint8_t ack[] = {0x01, 0x04, 0x05};
+	XpressNet xn;
+	VirtualClock clock; // accessed by engine thread only
+	EngineThread engine(xn);
+	engine.start();
+	LoopbackTransport *li = nullptr;
+	engine.call([&li, &clock](XpressNet &xn) { li = &Bench::loopback(xn, LIType::LI101, clock); });
+
+	// LI acknowledges on the engine thread, as soon as the command is sent
+	auto setSpeed = [&engine, &clock, li, ok, err](size_t i) {
+		engine.post([&engine, &clock, li, i, ok, err](XpressNet &xn) {
+			clock.advance(msToTimestamp(1000));
+			xn.setSpeed(3, i % 28, Direction::Forward,
+			            engine.onHost(std::make_unique<Cb>([ok](void *s, void *) { callEv(s, ok); })),
+			            engine.onHost(std::make_unique<Cb>([err](void *s, void *) { callEv(s, err); })));
+			li->injectNow(ack, sizeof(ack));
+		});
+	};
+
+	// Host posts & waits for the callback: cross-thread post + host queue round trip
+	Bench::run("api/set_speed_engine_thread", 20000, [&setSpeed](size_t i) {
+		const size_t expected = apiCallbacks + 1;
+		setSpeed(i);
+		waitCallbacks(expected);
+	});
+
+	// Host posts a burst of 64 commands & waits for all callbacks
+	constexpr size_t _BURST = 64;
+	Bench::run("api/set_speed_engine_thread_burst64", 1000, [&setSpeed](size_t i) {
+		const size_t expected = apiCallbacks + _BURST;
+		for (size_t j = 0; j < _BURST; j++)
+			setSpeed(i*_BURST + j);
+		waitCallbacks(expected);
+	});
+
+	engine.stop();
+}
+
+void benchApi() {
+	const LibStdCallback ok {apiCallback, nullptr};
+	const LibStdCallback err {apiCallback, nullptr};
+	static const uint8_t ack[] = {0x01, 0x04, 0x05};
+
+	Bench::run("api/callback_wrap", 1000000, [&ok, &err](size_t) {
+		UPCb cbOk = std::make_unique<Cb>([ok](void *s, void *) { callEv(s, ok); });
+		UPCb cbErr = std::make_unique<Cb>([err](void *s, void *) { callEv(s, err); });
+		cbOk->func(nullptr, cbOk->data);
+	});
+
+	XpressNet xn;
+	VirtualClock clock;
+	LoopbackTransport &li = Bench::loopback(xn, LIType::LI101, clock);
+	EngineThread engine(xn); // not started: tasks are executed inline
+
+	// XpressNet API called directly with no callbacks
+	Bench::run("api/set_speed_direct", 200000, [&xn, &clock, &li](size_t i) {
+		clock.advance(msToTimestamp(1000)); // no pacing delay
+		xn.setSpeed(3, i % 28, Direction::Forward);
+		li.injectNow(ack, sizeof(ack));
+	});
+
+	// LibStdCallbacks wrapped into Cb lambdas
+	Bench::run("api/set_speed_callbacks", 200000, [&xn, &clock, &li, &ok, &err](size_t i) {
+		clock.advance(msToTimestamp(1000));
+		xn.setSpeed(3, i % 28, Direction::Forward,
+		            std::make_unique<Cb>([ok](void *s, void *) { callEv(s, ok); }),
+		            std::make_unique<Cb>([err](void *s, void *) { callEv(s, err); }));
+		li.injectNow(ack, sizeof(ack));
+	});
+
+	// As lib-api.cpp: task posted to the engine & callbacks wrapped for the host
+	Bench::run("api/set_speed_engine", 200000, [&engine, &clock, &li, &ok, &err](size_t i) {
+		clock.advance(msToTimestamp(1000));
+		engine.post([&engine, i, ok, err](XpressNet &xn) {
+			xn.setSpeed(3, i % 28, Direction::Forward,
+			            engine.onHost(std::make_unique<Cb>([ok](void *s, void *) { callEv(s, ok); })),
+			            engine.onHost(std::make_unique<Cb>([err](void *s, void *) { callEv(s, err); })));
+		});
+		li.injectNow(ack, sizeof(ack));
+	});
+
+	benchApiEngineThread(ok, err);
+}
+
+} // namespace Xn
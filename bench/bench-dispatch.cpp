@@ -0,0 +1,93 @@
+#include <memory>
+
+#include "bench.h"
+
+/* Command dispatch benchmarks: command type identification & the receive
+ * path from query through reply to user callback. */
+
+namespace Xn {
+
+std::vector<std::unique_ptr<const Cmd>> benchCommands() {
+	std::vector<std::unique_ptr<const Cmd>> cmds;
+	cmds.emplace_back(std::make_unique<CmdOff>());
+	cmds.emplace_back(std::make_unique<CmdOn>());
+	cmds.emplace_back(std::make_unique<CmdEmergencyStop>());
+	cmds.emplace_back(std::make_unique<CmdEmergencyStopLoco>(3));
+	cmds.emplace_back(std::make_unique<CmdGetLIVersion>(nullptr));
+	cmds.emplace_back(std::make_unique<CmdGetLIAddress>(nullptr));
+	cmds.emplace_back(std::make_unique<CmdSetLIAddress>(1));
+	cmds.emplace_back(std::make_unique<CmdGetCSVersion>(nullptr));
+	cmds.emplace_back(std::make_unique<CmdGetCSStatus>());
+	cmds.emplace_back(std::make_unique<CmdPomWriteCv>(3, 1, 3));
+	cmds.emplace_back(std::make_unique<CmdPomWriteBit>(3, 29, 1, true));
+	cmds.emplace_back(std::make_unique<CmdGetLocoInfo>(3, nullptr));
+	cmds.emplace_back(std::make_unique<CmdGetLocoFunc1328>(3, nullptr));
+	cmds.emplace_back(std::make_unique<CmdSetSpeedDir>(3, 10, Direction::Forward));
+	cmds.emplace_back(std::make_unique<CmdSetFuncA>(3, FA(0x10)));
+	cmds.emplace_back(std::make_unique<CmdSetFuncB>(3, FB(0x01), FSet::F5toF8));
+	cmds.emplace_back(std::make_unique<CmdSetFuncC>(3, FC(0x01)));
+	cmds.emplace_back(std::make_unique<CmdSetFuncD>(3, FD(0x01)));
+	cmds.emplace_back(std::make_unique<CmdReadDirect>(1, nullptr));
+	cmds.emplace_back(std::make_unique<CmdWriteDirect>(1, 3));
+	cmds.emplace_back(std::make_unique<CmdRequestReadResult>(1, nullptr));
+	cmds.emplace_back(std::make_unique<CmdRequestWriteResult>(1, 3));
+	cmds.emplace_back(std::make_unique<CmdAccInfoRequest>(1, false));
+	cmds.emplace_back(std::make_unique<CmdAccOpRequest>(10, true));
+	return cmds;
+}
+
+void benchDispatch() {
+	const auto cmds = benchCommands();
+	volatile size_t sink = 0;
+
+	// Baseline: RTTI-based identification used before commands were tagged
+	Bench::run("dispatch/is_rtti", 1000000, [&cmds, &sink](size_t i) {
+		const Cmd &cmd = *cmds[i % cmds.size()];
+		sink = sink + (dynamic_cast<const CmdSetSpeedDir *>(&cmd) != nullptr);
+	});
+	Bench::run("dispatch/is_tag", 1000000, [&cmds, &sink](size_t i) {
+		sink = sink + is<CmdSetSpeedDir>(*cmds[i % cmds.size()]);
+	});
+	Bench::run("dispatch/conflict_all_pairs", 100000, [&cmds, &sink](size_t i) {
+		const Cmd &cmd = *cmds[i % cmds.size()];
+		for (const auto &other : cmds)
+			sink = sink + (cmd.conflict(*other) || other->conflict(cmd));
+	});
+
+	// Receive path: loco information query -> 0xE4 reply -> GotLocoInfo callback
+	XpressNet xn;
+	VirtualClock clock;
+	LoopbackTransport &li = Bench::loopback(xn, LIType::LI101, clock);
+	size_t callbacks = 0;
+	GotLocoInfo gotLocoInfo = [&callbacks](void *, bool, Direction, unsigned, FA, FB) {
+		callbacks++;
+	};
+	Bench::run("receive/loco_info_to_callback", 200000, [&xn, &clock, &li, &gotLocoInfo](size_t) {
+		clock.advance(msToTimestamp(1000)); // no pacing delay
+		xn.getLocoInfo(3, gotLocoInfo);
+		static const uint8_t data[] = {0xE4, 0x04, 0x8A, 0x00, 0x00, 0x6A};
+		li.injectNow(data, sizeof(data));
+	});
+	sink = sink + callbacks;
+
+	// Receive framing: burst of 64 feedback broadcasts over LI-USB-Ethernet
+	std::vector<uint8_t> burst;
+	for (uint8_t group = 0; group < 64; group++) {
+		const uint8_t data = 0x40 | (group & 0x0F);
+		burst.insert(burst.end(), {0xFF, 0xFD, 0x42, group, data,
+		                           static_cast<uint8_t>(0x42 ^ group ^ data)});
+	}
+	Framer framer;
+	framer.setLiHeader(true);
+	MsgView frame;
+	Bench::run("receive/framer_feedback_burst", 20000, [&framer, &burst, &frame, &sink](size_t) {
+		size_t appended = 0;
+		while (appended < burst.size()) {
+			appended += framer.append(burst.data() + appended, burst.size() - appended);
+			while (framer.next(frame) != FrameResult::NeedMore)
+				sink = sink + frame.size();
+		}
+	});
+}
+
+} // namespace Xn
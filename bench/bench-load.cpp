@@ -0,0 +1,516 @@
+#include <QEventLoop>
+#include <QTimer>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <random>
+
+#include "bench.h"
+
+/* End-to-end load generator. XpressNet is driven through a simulated LI &
+ * command station with configurable response latency, jitter, loss & XOR
+ * corruption. Realistic mixes of commands are issued (locos changing speed,
+ * function toggles, accessory routes) while the command station floods the
+ * PC with feedback broadcasts. Throughput, retries & latency percentiles per
+ * command type are reported, so it could be estimated how many locos
+ * a single LI runs before latency becomes unacceptable.
+ *
+ * Runs in real time (XpressNet timers need the event loop).
+ */
+
+namespace Xn {
+
+///////////////////////////////////////////////////////////////////////////////
+
+struct LoadConfig {
+	std::vector<unsigned> locos {10, 20, 40, 80}; // one run for each count
+	unsigned duration = 10; // s per run
+	unsigned drain = 5; // s to wait for outstanding commands after a run
+
+	double latency = 15; // ms, LI & command station response latency
+	double jitter = 5; // ms, uniformly distributed on top of latency
+	double service = 2; // ms, command station processes commands one by one
+	double loss = 0; // probability a response is lost
+	double corrupt = 0; // probability a response has bad XOR
+	bool eth = false; // LI-USB-Ethernet instead of LI101
+	unsigned seed = 1;
+
+	double speedRate = 0.5; // speed changes per loco per s
+	double funcRate = 0.1; // function toggles per loco per s
+	double routeRate = 0.2; // routes per s
+	unsigned routeLength = 6; // turnouts per route
+	double feedbackRate = 20; // feedback broadcasts per s
+
+	XNConfig xn;
+};
+
+static double argDouble(const QStringList &args, const QString &name, double def) {
+	const int i = args.indexOf(name);
+	if ((i < 0) || (i+1 >= args.size()))
+		return def;
+	bool ok;
+	const double value = args[i+1].toDouble(&ok);
+	if (!ok)
+		throw QStrException("Invalid value of " + name + ": " + args[i+1]);
+	return value;
+}
+
+static LoadConfig loadConfig(const QStringList &args) {
+	LoadConfig config;
+
+	const int locos = args.indexOf("--locos");
+	if ((locos >= 0) && (locos+1 < args.size())) {
+		config.locos.clear();
+		for (const QString &count : args[locos+1].split(',')) {
+			bool ok;
+			config.locos.push_back(count.toUInt(&ok));
+			if ((!ok) || (config.locos.back() == 0) || (config.locos.back() > 9999))
+				throw QStrException("Invalid loco count: " + count);
+		}
+	}
+
+	config.duration = static_cast<unsigned>(argDouble(args, "--duration", config.duration));
+	config.drain = static_cast<unsigned>(argDouble(args, "--drain", config.drain));
+	config.latency = argDouble(args, "--latency", config.latency);
+	config.jitter = argDouble(args, "--jitter", config.jitter);
+	config.service = argDouble(args, "--service", config.service);
+	config.loss = argDouble(args, "--loss", config.loss);
+	config.corrupt = argDouble(args, "--corrupt", config.corrupt);
+	config.eth = args.contains("--eth");
+	config.seed = static_cast<unsigned>(argDouble(args, "--seed", config.seed));
+	config.speedRate = argDouble(args, "--speed-rate", config.speedRate);
+	config.funcRate = argDouble(args, "--func-rate", config.funcRate);
+	config.routeRate = argDouble(args, "--route-rate", config.routeRate);
+	config.routeLength = static_cast<unsigned>(argDouble(args, "--route-length", config.routeLength));
+	config.feedbackRate = argDouble(args, "--feedback-rate", config.feedbackRate);
+
+	config.xn.outInterval = static_cast<size_t>(argDouble(args, "--out-interval",
+	                                                      config.xn.outInterval));
+	config.xn.pendingMax = static_cast<size_t>(argDouble(args, "--pending-max", config.xn.pendingMax));
+	config.xn.coalesce = args.contains("--coalesce");
+	if (args.contains("--adaptive"))
+		config.xn.pacing = PacingMode::Adaptive;
+	return config;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Simulated LI & command station
+
+class SimulatedLi {
+public:
+	struct Stats {
+		size_t responses = 0;
+		size_t lost = 0;
+		size_t corrupted = 0;
+		size_t feedbacks = 0;
+	} stats;
+
+	SimulatedLi(LoopbackTransport &li, const LoadConfig &config, std::mt19937 &random)
+	    : m_li(li), m_config(config), m_random(random) {
+		m_timer.setSingleShot(true);
+		m_timer.setTimerType(Qt::PreciseTimer);
+		QObject::connect(&m_timer, &QTimer::timeout, [this]() { this->deliver(); });
+		m_li.onWrite = [this](const uint8_t *data, size_t len) { this->received(data, len); };
+	}
+
+	void broadcastFeedback() {
+		// 1-7 group/nibble pairs of random inputs
+		std::uniform_int_distribution<unsigned> pairs(1, 7);
+		std::uniform_int_distribution<unsigned> byte(0, 255);
+		std::vector<uint8_t> msg;
+		const unsigned count = pairs(m_random);
+		msg.push_back(static_cast<uint8_t>(0x40 | (2*count)));
+		for (unsigned i = 0; i < count; i++) {
+			msg.push_back(static_cast<uint8_t>(byte(m_random)));
+			msg.push_back(static_cast<uint8_t>(0x40 | (byte(m_random) & 0x1F)));
+		}
+		stats.feedbacks++;
+		this->schedule(std::move(msg), m_clock.now(), false); // broadcasts are not delayed
+	}
+
+private:
+	LoopbackTransport &m_li;
+	const LoadConfig &m_config;
+	std::mt19937 &m_random;
+	SteadyClock m_clock;
+	QTimer m_timer;
+	Timestamp m_busyUntil = 0;
+	std::deque<std::pair<Timestamp, std::vector<uint8_t>>> m_queue; // ordered by time
+
+	// Engine writes whole frames
+	void received(const uint8_t *data, size_t len) {
+		if (m_config.eth) {
+			data += 2;
+			len -= 2;
+		}
+		std::vector<uint8_t> response = this->response(data, len);
+		if (response.empty())
+			return;
+
+		const Timestamp now = m_clock.now();
+		m_busyUntil = std::max(now, m_busyUntil) + static_cast<Timestamp>(m_config.service * 1000);
+		std::uniform_real_distribution<double> uniform(0, 1);
+		if (uniform(m_random) < m_config.loss) {
+			stats.lost++;
+			return;
+		}
+		const bool corrupt = (uniform(m_random) < m_config.corrupt);
+		if (corrupt)
+			stats.corrupted++;
+
+		const double delay = m_config.latency + (m_config.jitter * uniform(m_random));
+		this->schedule(std::move(response), m_busyUntil + static_cast<Timestamp>(delay * 1000),
+		               corrupt);
+	}
+
+	std::vector<uint8_t> response(const uint8_t *data, size_t len) const {
+		const std::vector<uint8_t> ok {0x01, 0x04};
+		if (len < 2)
+			return {};
+
+		switch (data[0]) {
+		case 0x21:
+			if (data[1] == 0x80)
+				return {0x61, 0x00};
+			if (data[1] == 0x81)
+				return {0x61, 0x01};
+			if (data[1] == 0x21)
+				return {0x63, 0x21, 0x36, 0x00};
+			if (data[1] == 0x24)
+				return {0x62, 0x22, 0x00};
+			return ok;
+		case 0x80:
+			return {0x81, 0x00};
+		case 0xF0:
+			return {0x02, 0x30, 0x40};
+		case 0xF2:
+			return {0xF2, 0x01, 0x01};
+		case 0xE3:
+			if (data[1] == 0x00)
+				return {0xE4, 0x04, 0x00, 0x00, 0x00};
+			if (data[1] == 0x09)
+				return {0xE3, 0x52, 0x00, 0x00};
+			return {};
+		case 0x42:
+			return {0x42, data[1], static_cast<uint8_t>(0x40 | ((data[2] & 0x01) << 4))};
+		case 0x52:
+			// LI101 does not acknowledge activation of accessory output
+			if ((!m_config.eth) && (data[2] & 0x08))
+				return {};
+			return ok;
+		default:
+			return ok;
+		}
+	}
+
+	void schedule(std::vector<uint8_t> msg, Timestamp at, bool corrupt) {
+		// The LI sends messages one by one
+		if ((!m_queue.empty()) && (at < m_queue.back().first))
+			at = m_queue.back().first;
+
+		uint8_t x = 0;
+		for (uint8_t byte : msg)
+			x ^= byte;
+		msg.push_back(corrupt ? static_cast<uint8_t>(~x) : x);
+		if (m_config.eth)
+			msg.insert(msg.begin(), {0xFF, 0xFD});
+
+		m_queue.emplace_back(at, std::move(msg));
+		if (!m_timer.isActive())
+			this->startTimer();
+	}
+
+	void startTimer() {
+		const Timestamp wait = m_queue.front().first - m_clock.now();
+		m_timer.start(static_cast<int>((std::max<Timestamp>(wait, 0) + 999) / 1000));
+	}
+
+	void deliver() {
+		const Timestamp now = m_clock.now();
+		while ((!m_queue.empty()) && (m_queue.front().first <= now)) {
+			m_li.inject(m_queue.front().second.data(), m_queue.front().second.size());
+			m_queue.pop_front();
+			stats.responses++;
+		}
+		if (!m_queue.empty())
+			this->startTimer();
+	}
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Load generator
+
+struct LoadRecord {
+	CmdType type;
+	std::vector<uint8_t> frame; // as written to the LI
+	Timestamp issued;
+	Timestamp sent = 0; // first send
+	Timestamp lastSent = 0;
+	Timestamp done = 0;
+	size_t retries = 0;
+	bool error = false;
+	bool superseded = false;
+};
+
+struct LoadTypeStats {
+	size_t count = 0;
+	size_t errors = 0;
+	size_t superseded = 0;
+	size_t retries = 0;
+	std::vector<double> queue; // ms, issued -> first sent
+	std::vector<double> rtt; // ms, last sent -> response
+	std::vector<double> latency; // ms, issued -> response
+};
+
+class LoadRun {
+public:
+	LoadRun(const LoadConfig &config, unsigned locos)
+	    : m_config(config), m_locos(locos), m_random(config.seed), m_speeds(locos, 0),
+	      m_funcs(locos, 0) {}
+
+	void run() {
+		xn.setConfig(m_config.xn);
+		auto transport = std::make_unique<LoopbackTransport>();
+		LoopbackTransport &li = *transport;
+		SimulatedLi sim(li, m_config, m_random);
+		m_sim = &sim;
+		li.onWrite = [this, write = li.onWrite](const uint8_t *data, size_t len) {
+			this->written(data, len);
+			write(data, len);
+		};
+		xn.connect(std::move(transport), m_config.eth ? LIType::LIUSBEth : LIType::LI101);
+
+		QTimer tick;
+		tick.setTimerType(Qt::PreciseTimer);
+		Timestamp lastTick = m_clock.now();
+		QObject::connect(&tick, &QTimer::timeout, [this, &lastTick]() {
+			const Timestamp now = m_clock.now();
+			this->generate(static_cast<double>(now - lastTick) / 1e6);
+			lastTick = now;
+		});
+
+		m_begin = m_clock.now();
+		tick.start(_TICK);
+		this->wait(m_config.duration * 1000);
+		tick.stop();
+		m_end = m_clock.now();
+
+		// Let outstanding commands finish
+		for (unsigned i = 0; (i < m_config.drain*10) && (m_outstanding > 0); i++)
+			this->wait(100);
+		m_finished = true;
+		xn.disconnect();
+		m_liStats = sim.stats;
+		m_sim = nullptr;
+	}
+
+	void printJson(bool last) const;
+
+private:
+	static constexpr int _TICK = 5; // ms
+
+	const LoadConfig &m_config;
+	const unsigned m_locos;
+	XpressNet xn;
+	SteadyClock m_clock;
+	std::mt19937 m_random;
+	SimulatedLi *m_sim = nullptr;
+	SimulatedLi::Stats m_liStats;
+	std::vector<uint8_t> m_speeds;
+	std::vector<uint8_t> m_funcs;
+	std::deque<LoadRecord> m_records;
+	std::map<std::vector<uint8_t>, std::deque<size_t>> m_waiting; // issued, not sent
+	std::map<std::vector<uint8_t>, std::deque<size_t>> m_inflight; // sent, no response
+	size_t m_outstanding = 0;
+	Timestamp m_begin = 0;
+	Timestamp m_end = 0;
+	bool m_finished = false;
+
+	void wait(int ms) {
+		QEventLoop loop;
+		QTimer::singleShot(ms, &loop, &QEventLoop::quit);
+		loop.exec();
+	}
+
+	bool happens(double rate, double dt) {
+		std::uniform_real_distribution<double> uniform(0, 1);
+		return uniform(m_random) < rate*dt;
+	}
+
+	void generate(double dt) {
+		std::uniform_int_distribution<unsigned> speed(0, 28);
+		for (unsigned i = 0; i < m_locos; i++) {
+			const LocoAddr addr(static_cast<uint16_t>(i+1));
+			if (this->happens(m_config.speedRate, dt)) {
+				m_speeds[i] = static_cast<uint8_t>(speed(m_random));
+				const size_t id = this->track(CmdSetSpeedDir(addr, m_speeds[i], Direction::Forward));
+				xn.setSpeed(addr, m_speeds[i], Direction::Forward, this->okCb(id), this->errCb(id),
+				            this->supersededCb(id));
+			}
+			if (this->happens(m_config.funcRate, dt)) {
+				m_funcs[i] ^= static_cast<uint8_t>(1 << (m_random() % 5));
+				const FA fa(m_funcs[i]);
+				const size_t id = this->track(CmdSetFuncA(addr, fa));
+				xn.setFuncA(addr, fa, this->okCb(id), this->errCb(id), this->supersededCb(id));
+			}
+		}
+
+		if (this->happens(m_config.routeRate, dt)) {
+			for (unsigned i = 0; i < m_config.routeLength; i++) {
+				const uint16_t port = static_cast<uint16_t>(m_random() % 1024);
+				for (bool state : {true, false}) {
+					const size_t id = this->track(CmdAccOpRequest(port, state));
+					xn.accOpRequest(port, state, this->okCb(id), this->errCb(id));
+				}
+			}
+		}
+
+		if ((m_sim != nullptr) && this->happens(m_config.feedbackRate, dt))
+			m_sim->broadcastFeedback();
+	}
+
+	size_t track(const Cmd &cmd) {
+		Frame frame = cmd.getBytes();
+		frame.seal(m_config.eth);
+		LoadRecord record;
+		record.type = cmd.type();
+		record.frame.assign(frame.begin(), frame.end());
+		record.issued = m_clock.now();
+		m_records.push_back(std::move(record));
+
+		const size_t id = m_records.size()-1;
+		m_waiting[m_records.back().frame].push_back(id);
+		m_outstanding++;
+		return id;
+	}
+
+	void written(const uint8_t *data, size_t len) {
+		const std::vector<uint8_t> frame(data, data+len);
+		const Timestamp now = m_clock.now();
+
+		// Pending commands never conflict, so identical in-flight frame = retry
+		auto inflight = m_inflight.find(frame);
+		if ((inflight != m_inflight.end()) && (!inflight->second.empty())) {
+			LoadRecord &record = m_records[inflight->second.front()];
+			record.retries++;
+			record.lastSent = now;
+			return;
+		}
+
+		auto waiting = m_waiting.find(frame);
+		if ((waiting == m_waiting.end()) || (waiting->second.empty()))
+			return; // not tracked
+		const size_t id = waiting->second.front();
+		waiting->second.pop_front();
+		m_records[id].sent = now;
+		m_records[id].lastSent = now;
+		m_inflight[frame].push_back(id);
+	}
+
+	void finished(size_t id, bool error, bool superseded) {
+		LoadRecord &record = m_records[id];
+		if (m_finished || (record.done > 0))
+			return;
+		record.done = m_clock.now();
+		record.error = error;
+		record.superseded = superseded;
+		m_outstanding--;
+
+		for (auto *map : {&m_waiting, &m_inflight}) {
+			auto it = map->find(record.frame);
+			if (it != map->end())
+				it->second.erase(std::remove(it->second.begin(), it->second.end(), id),
+				                 it->second.end());
+		}
+	}
+
+	UPCb okCb(size_t id) {
+		return std::make_unique<Cb>([this, id](void *, void *) { this->finished(id, false, false); });
+	}
+	UPCb errCb(size_t id) {
+		return std::make_unique<Cb>([this, id](void *, void *) { this->finished(id, true, false); });
+	}
+	UPCb supersededCb(size_t id) {
+		return std::make_unique<Cb>([this, id](void *, void *) { this->finished(id, false, true); });
+	}
+};
+
+// 'values' must be sorted
+static double percentile(const std::vector<double> &values, double q) {
+	if (values.empty())
+		return 0;
+	const size_t i = std::min(values.size()-1, static_cast<size_t>(q * values.size()));
+	return values[i];
+}
+
+static void printPercentiles(const char *name, std::vector<double> &values, bool comma) {
+	std::sort(values.begin(), values.end());
+	std::printf("\"%s\": {\"p50\": %.2f, \"p99\": %.2f, \"p999\": %.2f, \"max\": %.2f}%s", name,
+	            percentile(values, 0.5), percentile(values, 0.99), percentile(values, 0.999),
+	            values.empty() ? 0 : values.back(), comma ? ", " : "");
+}
+
+void LoadRun::printJson(bool last) const {
+	std::map<CmdType, LoadTypeStats> types;
+	size_t completed = 0, retries = 0, errors = 0, unfinished = 0;
+	for (const LoadRecord &record : m_records) {
+		LoadTypeStats &stats = types[record.type];
+		stats.count++;
+		stats.retries += record.retries;
+		retries += record.retries;
+		if (record.done == 0) {
+			unfinished++;
+		} else if (record.superseded) {
+			stats.superseded++;
+		} else if (record.error) {
+			stats.errors++;
+			errors++;
+		} else {
+			completed++;
+			if (record.sent > 0) {
+				stats.queue.push_back(static_cast<double>(record.sent - record.issued) / 1000);
+				stats.rtt.push_back(static_cast<double>(record.done - record.lastSent) / 1000);
+			}
+			stats.latency.push_back(static_cast<double>(record.done - record.issued) / 1000);
+		}
+	}
+
+	const double seconds = static_cast<double>(m_end - m_begin) / 1e6;
+	std::printf("\t\t{\"locos\": %u, \"duration_s\": %.2f, \"issued\": %zu, \"completed\": %zu, "
+	            "\"commands_per_s\": %.2f, \"retries\": %zu, \"errors\": %zu, \"unfinished\": %zu,\n",
+	            m_locos, seconds, m_records.size(), completed, completed / seconds, retries, errors,
+	            unfinished);
+	std::printf("\t\t \"li\": {\"responses\": %zu, \"lost\": %zu, \"corrupted\": %zu, "
+	            "\"feedbacks\": %zu},\n",
+	            m_liStats.responses, m_liStats.lost, m_liStats.corrupted, m_liStats.feedbacks);
+	std::printf("\t\t \"types\": [\n");
+	size_t i = 0;
+	for (auto &type : types) {
+		LoadTypeStats &stats = type.second;
+		std::printf("\t\t\t{\"type\": \"%s\", \"count\": %zu, \"errors\": %zu, \"superseded\": %zu, "
+		            "\"retries\": %zu, ",
+		            cmdTypeName(type.first), stats.count, stats.errors, stats.superseded, stats.retries);
+		printPercentiles("queue_ms", stats.queue, true);
+		printPercentiles("rtt_ms", stats.rtt, true);
+		printPercentiles("latency_ms", stats.latency, false);
+		std::printf("}%s\n", (++i < types.size()) ? "," : "");
+	}
+	std::printf("\t\t]}%s\n", last ? "" : ",");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void benchLoad(const QStringList &args) {
+	const LoadConfig config = loadConfig(args);
+
+	std::printf("{\n\t\"load\": [\n");
+	for (size_t i = 0; i < config.locos.size(); i++) {
+		LoadRun run(config, config.locos[i]);
+		run.run();
+		run.printJson(i+1 == config.locos.size());
+		std::fflush(stdout);
+	}
+	std::printf("\t]\n}\n");
+}
+
+} // namespace Xn
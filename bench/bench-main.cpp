@@ -0,0 +1,49 @@
+#include <QCoreApplication>
+
+#include "bench.h"
+
+/* Micro-benchmark suite entry point. Prints JSON results to stdout.
+ * Usage: xn-bench [--replay trace-file]
+ *        xn-bench --load [options] (end-to-end load test, see bench-load.cpp)
+ *        xn-bench --tcp (TCP transport against LI-USB-Ethernet stand-in)
+ */
+
+int main(int argc, char *argv[]) {
+	QCoreApplication app(argc, argv);
+	const QStringList args = app.arguments();
+
+	if (args.contains("--load")) {
+		try {
+			Xn::benchLoad(args);
+		} catch (const Xn::QStrException &e) {
+			std::fprintf(stderr, "%s\n", e.str().toStdString().c_str());
+			return 1;
+		}
+		return 0;
+	}
+
+	if (args.contains("--tcp")) {
+		const bool ok = Xn::benchTcp();
+		Xn::Bench::printJson();
+		return ok ? 0 : 1;
+	}
+
+	Xn::benchDispatch();
+	Xn::benchSend();
+	Xn::benchReceive();
+	Xn::benchQueue();
+	Xn::benchApi();
+
+	const int replay = args.indexOf("--replay");
+	if ((replay >= 0) && (replay+1 < args.size())) {
+		try {
+			Xn::benchReplay(args[replay+1]);
+		} catch (const Xn::QStrException &e) {
+			std::fprintf(stderr, "%s\n", e.str().toStdString().c_str());
+			return 1;
+		}
+	}
+
+	Xn::Bench::printJson();
+	return 0;
+}
@@ -0,0 +1,52 @@
+#include "bench.h"
+
+/* Queue benchmarks: conflict detection against pending & outgoing queues at
+ * various queue depths. */
+
+namespace Xn {
+
+// Speed commands for locos 1..depth mixed with accessory operations
+static std::unique_ptr<const Cmd> queueCmd(size_t i) {
+	if (i % 4 == 3)
+		return std::make_unique<const CmdAccOpRequest>(static_cast<uint16_t>(i), true);
+	return std::make_unique<const CmdSetSpeedDir>(LocoAddr(static_cast<uint16_t>(i+1)), 10,
+	                                              Direction::Forward);
+}
+
+void benchQueue() {
+	volatile size_t sink = 0;
+
+	for (size_t depth : {1, 8, 64, 512}) {
+		// Same queues as pending buffer & outgoing queue of XpressNet
+		CmdQueue pending;
+		OutQueue out;
+		for (size_t i = 0; i < depth; i++) {
+			std::unique_ptr<const Cmd> cmd = queueCmd(i);
+			pending.emplace_back(cmd, 0, 1, nullptr, nullptr);
+			std::unique_ptr<const Cmd> outCmd = queueCmd(i);
+			out.push(PendingItem(outCmd, 0, 1, nullptr, nullptr));
+		}
+
+		const std::string suffix = "/depth" + std::to_string(depth);
+		const CmdSetSpeedDir hit(1, 20, Direction::Backward);
+		const CmdSetSpeedDir miss(9000, 20, Direction::Backward);
+
+		Bench::run("conflict/pending_hit" + suffix, 1000000, [&pending, &hit, &sink](size_t) {
+			sink = sink + pending.conflict(hit);
+		});
+		Bench::run("conflict/pending_miss" + suffix, 1000000, [&pending, &miss, &sink](size_t) {
+			sink = sink + pending.conflict(miss);
+		});
+		Bench::run("conflict/out_hit" + suffix, 1000000, [&out, &hit, &sink](size_t) {
+			sink = sink + out.conflict(hit);
+		});
+		Bench::run("conflict/out_miss" + suffix, 1000000, [&out, &miss, &sink](size_t) {
+			sink = sink + out.conflict(miss);
+		});
+		Bench::run("conflict/out_coalesce_lookup" + suffix, 1000000, [&out, &hit, &sink](size_t) {
+			sink = sink + (out.lastSameTarget(hit) != nullptr);
+		});
+	}
+}
+
+} // namespace Xn
@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <functional>
+
+#include "bench.h"
+
+/* Receive path benchmarks: framing of byte stream read from the transport
+ * (fragmented, with & without LI-USB-Ethernet header), parsing of each
+ * broadcast & round trip of each command answered by a message (command sent
+ * through the API, reply injected by LI). */
+
+namespace Xn {
+
+struct ReceiveMsg {
+	const char *name;
+	std::vector<uint8_t> data; // without XOR
+	// Sends the command the message answers, nullptr for broadcasts
+	std::function<void(XpressNet &)> request;
+};
+
+static std::vector<ReceiveMsg> receiveMsgs() {
+	return {
+		{"li_ok", {0x01, 0x04},
+		 [](XpressNet &xn) { xn.setSpeed(3, 10, Direction::Forward); }},
+		{"li_version", {0x02, 0x30, 0x40},
+		 [](XpressNet &xn) { xn.getLIVersion([](void *, unsigned, unsigned) {}); }},
+		{"li_address", {0xF2, 0x01, 0x05},
+		 [](XpressNet &xn) { xn.getLIAddress([](void *, unsigned) {}); }},
+		{"cs_general_event", {0x61, 0x01}, nullptr},
+		{"cs_status", {0x62, 0x22, 0x00},
+		 [](XpressNet &xn) { xn.getCommandStationStatus(); }},
+		{"cs_version", {0x63, 0x21, 0x36, 0x00},
+		 [](XpressNet &xn) {
+			 xn.getCommandStationVersion([](void *, unsigned, unsigned, uint8_t) {});
+		 }},
+		{"loco_info", {0xE4, 0x04, 0x8A, 0x00, 0x00},
+		 [](XpressNet &xn) {
+			 xn.getLocoInfo(3, [](void *, bool, Direction, unsigned, FA, FB) {});
+		 }},
+		{"loco_func", {0xE3, 0x52, 0x00, 0x00},
+		 [](XpressNet &xn) { xn.getLocoFunc1328(3, [](void *, FC, FD) {}); }},
+		{"loco_stolen", {0xE3, 0x40, 0x00, 0x03}, nullptr},
+		{"feedback", {0x42, 0x05, 0x40}, nullptr},
+	};
+}
+
+void benchReceive() {
+	const auto msgs = receiveMsgs();
+
+	// Whole message per type: broadcasts parsed, other messages answer a command
+	for (const ReceiveMsg &msg : msgs) {
+		XpressNet xn;
+		VirtualClock clock;
+		LoopbackTransport &li = Bench::loopback(xn, LIType::LI101, clock);
+		const std::vector<uint8_t> data = Bench::frame(msg.data, LIType::LI101);
+		if (msg.request == nullptr) {
+			Bench::run(std::string("parse/") + msg.name, 1000000, [&li, &data](size_t) {
+				li.injectNow(data.data(), data.size());
+			});
+		} else {
+			Bench::run(std::string("reply/") + msg.name, 200000,
+			           [&xn, &clock, &li, &msg, &data](size_t) {
+				clock.advance(msToTimestamp(1000)); // no pacing delay
+				msg.request(xn);
+				li.injectNow(data.data(), data.size());
+			});
+		}
+	}
+
+	// Feedback broadcast of 7 nibbles: repeated state (no events) vs. all inputs changed
+	{
+		XpressNet xn;
+		VirtualClock clock;
+		LoopbackTransport &li = Bench::loopback(xn, LIType::LI101, clock);
+		std::vector<uint8_t> first {0x4E}, second {0x4E};
+		for (uint8_t group = 0; group < 7; group++) {
+			first.insert(first.end(), {group, 0x45});
+			second.insert(second.end(), {group, 0x4A});
+		}
+		const std::vector<uint8_t> a = Bench::frame(first, LIType::LI101);
+		const std::vector<uint8_t> b = Bench::frame(second, LIType::LI101);
+		Bench::run("parse/feedback_repeated", 1000000, [&li, &a](size_t) {
+			li.injectNow(a.data(), a.size());
+		});
+		Bench::run("parse/feedback_changed", 1000000, [&li, &a, &b](size_t i) {
+			const std::vector<uint8_t> &data = (i % 2) ? a : b;
+			li.injectNow(data.data(), data.size());
+		});
+	}
+
+	// Stream of 64 broadcasts delivered in fragments
+	for (LIType liType : {LIType::LI101, LIType::LIUSBEth}) {
+		std::vector<uint8_t> stream;
+		for (size_t i = 0, frames = 0; frames < 64; i++) {
+			const ReceiveMsg &msg = msgs[i % msgs.size()];
+			if (msg.request != nullptr)
+				continue;
+			frames++;
+			const std::vector<uint8_t> data = Bench::frame(msg.data, liType);
+			stream.insert(stream.end(), data.begin(), data.end());
+		}
+
+		for (size_t chunk : {size_t(1), size_t(3), size_t(7), stream.size()}) {
+			XpressNet xn;
+			VirtualClock clock;
+			LoopbackTransport &li = Bench::loopback(xn, liType, clock);
+			const std::string name = std::string("framing/") +
+			                         ((liType == LIType::LIUSBEth) ? "eth" : "li101") + "/" +
+			                         ((chunk == stream.size()) ? "whole" : "chunk" + std::to_string(chunk));
+
+			Bench::run(name, 5000, [&li, &stream, chunk](size_t) {
+				for (size_t pos = 0; pos < stream.size(); pos += chunk)
+					li.injectNow(stream.data() + pos, std::min(chunk, stream.size() - pos));
+			});
+		}
+	}
+}
+
+} // namespace Xn
@@ -0,0 +1,22 @@
+#include "bench.h"
+
+/* Parser throughput benchmark: received data of a trace (see xn-trace.h)
+ * replayed through the framer & parser at maximum speed. */
+
+namespace Xn {
+
+void benchReplay(const QString &filename) {
+	XpressNet xn;
+	TraceReplay replay(xn, filename);
+
+	replay.start(0); // count records
+	const size_t records = replay.replayed();
+	if (records == 0)
+		return;
+
+	Bench::run("replay/trace", 100, [&replay](size_t) { replay.start(0); });
+	const BenchResult &trace = Bench::results().back();
+	Bench::results().push_back({"replay/record", trace.iterations * records, trace.nsPerOp / records});
+}
+
+} // namespace Xn
@@ -0,0 +1,52 @@
+#include "bench.h"
+
+/* Send path benchmarks: encoding of each command type, assembly of the frame
+ * (XOR, LI-USB-Ethernet header) & the whole path of a command from the API to
+ * the transport (queues, pacer accounting), acknowledged by LI. */
+
+namespace Xn {
+
+void benchSend() {
+	const auto cmds = benchCommands();
+	volatile size_t sink = 0;
+
+	for (const auto &cmd : cmds) {
+		const Cmd &c = *cmd;
+		Bench::run(std::string("encode/") + cmdTypeName(c.type()), 1000000, [&c, &sink](size_t) {
+			sink = sink + c.getBytes().size();
+		});
+	}
+
+	const CmdSetSpeedDir speed(3, 10, Direction::Forward);
+	Bench::run("send/frame_seal", 1000000, [&speed, &sink](size_t) {
+		Frame frame = speed.getBytes();
+		frame.seal(false);
+		sink = sink + frame.size();
+	});
+	Bench::run("send/frame_seal_eth", 1000000, [&speed, &sink](size_t) {
+		Frame frame = speed.getBytes();
+		frame.seal(true);
+		sink = sink + frame.size();
+	});
+
+	// Command through the API to the transport, acknowledged by LI
+	for (LIType liType : {LIType::LI101, LIType::LIUSBEth}) {
+		XpressNet xn;
+		VirtualClock clock;
+		LoopbackTransport &li = Bench::loopback(xn, liType, clock);
+		size_t written = 0;
+		li.onWrite = [&written](const uint8_t *, size_t len) { written += len; };
+		const std::vector<uint8_t> ack = Bench::frame({0x01, 0x04}, liType);
+
+		const std::string name = (liType == LIType::LIUSBEth) ? "send/cmd_to_transport_eth"
+		                                                      : "send/cmd_to_transport";
+		Bench::run(name, 1000000, [&xn, &clock, &li, &ack](size_t i) {
+			clock.advance(msToTimestamp(1000)); // no pacing delay
+			xn.setSpeed(3, static_cast<uint8_t>(i % 28), Direction::Forward);
+			li.injectNow(ack.data(), ack.size());
+		});
+		sink = sink + written;
+	}
+}
+
+} // namespace Xn
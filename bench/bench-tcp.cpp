@@ -0,0 +1,220 @@
+#include <QEventLoop>
+#include <QHostAddress>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <algorithm>
+
+#include "bench.h"
+
+/* LI-USB-Ethernet connected via TCP (TcpTransport) against a local stand-in:
+ * a TCP server speaking the LI-USB-Ethernet framing (0xFF 0xFE header from
+ * PC, 0xFF 0xFD header to PC) answers commands like LI & command station.
+ * Checks that connecting does not block the engine & that a refused
+ * connection is reported (by onConnectError or EOpenError when refused
+ * immediately), measures round trip of commands over the loopback interface &
+ * checks that speed commands are pipelined (more than one in flight).
+ * Failed checks are printed to stderr.
+ *
+ * Runs in real time (sockets need the event loop).
+ */
+
+namespace Xn {
+
+class LiEthStandIn {
+public:
+	LiEthStandIn() {
+		QObject::connect(&m_server, &QTcpServer::newConnection, [this]() { this->accept(); });
+	}
+
+	bool listen() { return m_server.listen(QHostAddress::LocalHost, 0); }
+	uint16_t port() const { return m_server.serverPort(); }
+	size_t frames() const { return m_frames; }
+	size_t malformed() const { return m_malformed; }
+
+private:
+	QTcpServer m_server;
+	QTcpSocket *m_socket = nullptr; // owned by m_server
+	std::vector<uint8_t> m_rx;
+	size_t m_frames = 0;
+	size_t m_malformed = 0;
+
+	void accept() {
+		m_socket = m_server.nextPendingConnection();
+		QObject::connect(m_socket, &QTcpSocket::readyRead, [this]() { this->received(); });
+	}
+
+	void received() {
+		const QByteArray data = m_socket->readAll();
+		m_rx.insert(m_rx.end(), data.begin(), data.end());
+
+		// 0xFF 0xFE, XpressNET header (lower nibble = data length), data, xor
+		while (m_rx.size() >= 3) {
+			if ((m_rx[0] != 0xFF) || (m_rx[1] != 0xFE)) {
+				m_malformed++;
+				m_rx.erase(m_rx.begin());
+				continue;
+			}
+			const size_t len = 2 + 1 + (m_rx[2] & 0x0F) + 1;
+			if (m_rx.size() < len)
+				return;
+
+			uint8_t x = 0;
+			for (size_t i = 2; i < len; i++)
+				x ^= m_rx[i];
+			if (x == 0) {
+				m_frames++;
+				this->respond(m_rx[2], m_rx[3]);
+			} else {
+				m_malformed++;
+			}
+			m_rx.erase(m_rx.begin(), m_rx.begin() + static_cast<ptrdiff_t>(len));
+		}
+	}
+
+	void respond(uint8_t header, uint8_t first) {
+		std::vector<uint8_t> msg;
+		if (header == 0xF0)
+			msg = {0x02, 0x30, 0x40}; // LI version
+		else if ((header == 0xE3) && (first == 0x00))
+			msg = {0xE4, 0x04, 0x00, 0x00, 0x00}; // loco information
+		else
+			msg = {0x01, 0x04}; // OK
+
+		uint8_t x = 0;
+		for (uint8_t byte : msg)
+			x ^= byte;
+		msg.push_back(x);
+		msg.insert(msg.begin(), {0xFF, 0xFD});
+		m_socket->write(reinterpret_cast<const char *>(msg.data()), static_cast<qint64>(msg.size()));
+	}
+};
+
+// Runs the event loop till 'done' (set by a callback, which quits 'loop') or 'ms' elapse
+static bool tcpWait(QEventLoop &loop, const bool &done, int ms) {
+	if (!done) {
+		QTimer timeout;
+		timeout.setSingleShot(true);
+		QObject::connect(&timeout, &QTimer::timeout, &loop, &QEventLoop::quit);
+		timeout.start(ms);
+		loop.exec();
+	}
+	return done;
+}
+
+static double nsSince(std::chrono::steady_clock::time_point begin) {
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+}
+
+bool benchTcp() {
+	size_t failures = 0;
+	auto check = [&failures](bool condition, const char *what) {
+		if (!condition) {
+			std::fprintf(stderr, "tcp: %s\n", what);
+			failures++;
+		}
+	};
+	QEventLoop loop;
+	constexpr int _WAIT = _TCP_CONNECT_TIMEOUT + 500; // ms
+
+	{
+		// Refused connection: port of a closed server
+		QTcpServer closed;
+		check(closed.listen(QHostAddress::LocalHost, 0), "unable to listen on localhost");
+		const uint16_t port = closed.serverPort();
+		closed.close();
+
+		XpressNet xn;
+		bool failed = false;
+		QObject::connect(&xn, &XpressNet::onConnectError, [&failed, &loop](QString) {
+			failed = true;
+			loop.quit();
+		});
+		const auto begin = std::chrono::steady_clock::now();
+		try {
+			xn.connectTcp("127.0.0.1", port);
+			Bench::results().push_back({"tcp/connect_call", 1, nsSince(begin)});
+			check(xn.connecting() && !xn.connected(), "connectTcp did not return before connected");
+			check(tcpWait(loop, failed, _WAIT), "refused connection not reported by onConnectError");
+		} catch (const EOpenError &) {
+			// Refused immediately by the OS, reported synchronously
+		}
+		check(!xn.connecting(), "still connecting after refused connection");
+	}
+
+	LiEthStandIn li;
+	check(li.listen(), "unable to listen on localhost");
+	XpressNet xn;
+	XNConfig config;
+	config.pacing = PacingMode::Adaptive; // fixed pacing sends one frame per outInterval
+	xn.setConfig(config);
+	bool connected = false;
+	QObject::connect(&xn, &XpressNet::onConnect, [&connected, &loop]() {
+		connected = true;
+		loop.quit();
+	});
+	const auto begin = std::chrono::steady_clock::now();
+	xn.connectTcp("127.0.0.1", li.port());
+	check(!xn.connected(), "connectTcp blocked until connected");
+	check(tcpWait(loop, connected, _WAIT), "not connected to the stand-in");
+	Bench::results().push_back({"tcp/connect", 1, nsSince(begin)});
+	if (!connected)
+		return false;
+
+	// Sequential round trips
+	constexpr size_t _ROUND_TRIPS = 200;
+	size_t answered = 0;
+	const auto rtBegin = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < _ROUND_TRIPS; i++) {
+		bool done = false;
+		xn.getLIVersion(
+			[&done, &answered, &loop](void *, unsigned, unsigned) {
+				answered++;
+				done = true;
+				loop.quit();
+			},
+			std::make_unique<Cb>([&done, &loop](void *, void *) {
+				done = true;
+				loop.quit();
+			})
+		);
+		if (!tcpWait(loop, done, _WAIT))
+			break;
+	}
+	Bench::results().push_back({"tcp/li_version_round_trip", _ROUND_TRIPS,
+	                            nsSince(rtBegin) / _ROUND_TRIPS});
+	check(answered == _ROUND_TRIPS, "LI version not answered");
+
+	// Speed commands pipelined through the in-flight window (superseded ones are coalesced)
+	constexpr size_t _SPEEDS = 500;
+	size_t acknowledged = 0;
+	size_t finishedCount = 0;
+	uint64_t maxInFlight = 0;
+	bool allDone = false;
+	const auto speedBegin = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < _SPEEDS; i++) {
+		auto finished = [&acknowledged, &finishedCount, &allDone, &loop](bool ok) {
+			if (ok)
+				acknowledged++;
+			if (++finishedCount == _SPEEDS) {
+				allDone = true;
+				loop.quit();
+			}
+		};
+		xn.setSpeed(static_cast<uint16_t>(1 + i % 100), static_cast<uint8_t>(i % 28), Direction::Forward,
+		            std::make_unique<Cb>([finished](void *, void *) { finished(true); }),
+		            std::make_unique<Cb>([finished](void *, void *) { finished(false); }));
+		maxInFlight = std::max(maxInFlight, xn.metrics().engine().inFlight.load());
+	}
+	check(tcpWait(loop, allDone, static_cast<int>(_SPEEDS) * 100), "speed commands not finished");
+	Bench::results().push_back({"tcp/set_speed_pipelined", _SPEEDS, nsSince(speedBegin) / _SPEEDS});
+	check(acknowledged == _SPEEDS, "speed commands not acknowledged");
+	check(maxInFlight > 1, "speed commands not pipelined (at most 1 in flight)");
+	check(li.malformed() == 0, "stand-in received malformed frames");
+	check(li.frames() > _ROUND_TRIPS, "stand-in received no speed command");
+
+	xn.disconnect();
+	return (failures == 0);
+}
+
+} // namespace Xn
@@ -0,0 +1,97 @@
+#ifndef XN_BENCH_H
+#define XN_BENCH_H
+
+/*
+This file defines helpers for micro-benchmarks of the protocol core.
+Each benchmark runs a closure many times and records average time per
+operation. Results are printed as JSON, so they can be compared across
+releases.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../xn.h"
+
+namespace Xn {
+
+struct BenchResult {
+	std::string name;
+	size_t iterations;
+	double nsPerOp;
+};
+
+// Benchmarks drive XpressNet through its public API only: data from LI are
+// injected into LoopbackTransport, which delivers them synchronously.
+class Bench {
+public:
+	template <typename F>
+	static void run(const std::string &name, size_t iterations, F f) {
+		for (size_t i = 0; i < iterations/10; i++) // warm-up
+			f(i);
+		auto begin = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < iterations; i++)
+			f(i);
+		auto end = std::chrono::steady_clock::now();
+		double ns = std::chrono::duration<double, std::nano>(end - begin).count();
+		results().push_back({name, iterations, ns / iterations});
+	}
+
+	static void printJson() {
+		std::printf("{\n\t\"benchmarks\": [\n");
+		for (size_t i = 0; i < results().size(); i++) {
+			const BenchResult &r = results()[i];
+			std::printf("\t\t{\"name\": \"%s\", \"iterations\": %zu, \"ns_per_op\": %.2f}%s\n",
+			            r.name.c_str(), r.iterations, r.nsPerOp,
+			            (i+1 < results().size()) ? "," : "");
+		}
+		std::printf("\t]\n}\n");
+	}
+
+	static std::vector<BenchResult> &results() {
+		static std::vector<BenchResult> results;
+		return results;
+	}
+
+	// Connects 'xn' to in-memory LI driven by 'clock'. Returned transport is
+	// owned by 'xn'. There is no event loop in benchmarks: data from LI must be
+	// injected by 'injectNow'.
+	static LoopbackTransport &loopback(XpressNet &xn, LIType liType, const VirtualClock &clock) {
+		auto transport = std::make_unique<LoopbackTransport>();
+		LoopbackTransport &result = *transport;
+		xn.setTimeSource(&clock);
+		xn.connect(std::move(transport), liType);
+		return result;
+	}
+
+	// Message from LI as received: XOR appended, LI-USB-Ethernet header prepended
+	static std::vector<uint8_t> frame(const std::vector<uint8_t> &data, LIType liType) {
+		std::vector<uint8_t> result;
+		if (liType == LIType::LIUSBEth)
+			result = {0xFF, 0xFD};
+		uint8_t x = 0;
+		for (uint8_t byte : data)
+			x ^= byte;
+		result.insert(result.end(), data.begin(), data.end());
+		result.push_back(x);
+		return result;
+	}
+};
+
+std::vector<std::unique_ptr<const Cmd>> benchCommands(); // one command of each type
+
+void benchDispatch();
+void benchSend();
+void benchReceive();
+void benchQueue();
+void benchApi();
+void benchReplay(const QString &filename);
+void benchLoad(const QStringList &args); // prints its own JSON
+bool benchTcp(); // false = check failed
+
+} // namespace Xn
+
+#endif
@@ -0,0 +1,55 @@
+TARGET = xn-bench
+TEMPLATE = app
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += \
+	bench-main.cpp \
+	bench-dispatch.cpp \
+	bench-send.cpp \
+	bench-receive.cpp \
+	bench-queue.cpp \
+	bench-api.cpp \
+	bench-load.cpp \
+	bench-tcp.cpp \
+	bench-replay.cpp \
+	../xn.cpp \
+	../xn-api.cpp \
+	../xn-receive.cpp \
+	../xn-send.cpp \
+	../xn-pending.cpp \
+	../xn-trace.cpp \
+	../xn-transport.cpp \
+	../xn-engine-thread.cpp \
+	../xn-win-com-discover.cpp
+HEADERS += \
+	bench.h \
+	../xn.h \
+	../xn-loco-addr.h \
+	../xn-commands.h \
+	../xn-frame.h \
+	../xn-queue.h \
+	../xn-pacer.h \
+	../xn-metrics.h \
+	../xn-loco-cache.h \
+	../xn-feedback.h \
+	../xn-clock.h \
+	../xn-framer.h \
+	../xn-trace.h \
+	../xn-transport.h \
+	../xn-lockfree.h \
+	../xn-engine-thread.h \
+	../q-str-exception.h \
+	../xn-win-com-discover.h
+
+INCLUDEPATH += ..
+
+CONFIG += c++14 console
+CONFIG -= app_bundle
+QMAKE_CXXFLAGS += -Wall -Wextra -pedantic -O2
+
+win32 {
+	LIBS += -lsetupapi
+}
+
+QT += core serialport network
+QT -= gui
@@ -0,0 +1,217 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <atomic>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../lib-api.h"
+#include "../lib-main.h"
+
+/* Multi-threaded stress test of the library API (lib-api.cpp), intended to run
+ * under ThreadSanitizer (see README). Worker threads call locoSetSpeed,
+ * locoSetFunc, locoAcquire, connect/disconnect & bind* concurrently; the main
+ * thread is the library thread & runs the event loop. LI & command station are
+ * simulated on the engine thread: LoopbackTransport answers each command.
+ *
+ * The library's static objects (QApplication, LibMain) are created before
+ * main: run with QT_QPA_PLATFORM=offscreen. The library exports 'connect',
+ * which shadows the socket function in this executable, so no sockets are
+ * used here.
+ *
+ * Exit code is nonzero when the config is rejected, when no command is
+ * answered or when a callback or event is called on another thread than the
+ * library thread (ThreadSanitizer makes it nonzero on a data race too).
+ */
+
+namespace {
+
+using namespace Xn;
+
+constexpr size_t _THREADS = 8;
+constexpr size_t _ITERATIONS = 20000; // per thread
+const QString _CONFIG_FILENAME = "xn-stress.ini";
+
+std::thread::id libraryThread;
+std::atomic<size_t> wrongThread{0};
+std::atomic<size_t> workersRunning{_THREADS};
+
+// Library thread only: ThreadSanitizer reports a callback called elsewhere
+size_t callbacks = 0;
+size_t acquired = 0;
+size_t events = 0;
+
+void onLibraryThread() {
+	if (std::this_thread::get_id() != libraryThread)
+		wrongThread++;
+}
+
+void CALL_CONV stdCallback(void *, void *) {
+	onLibraryThread();
+	callbacks++;
+}
+
+void CALL_CONV acquiredCallback(const void *, LocoInfo) {
+	onLibraryThread();
+	acquired++;
+}
+
+void CALL_CONV notifyEvent(const void *, void *) {
+	onLibraryThread();
+	events++;
+}
+
+void CALL_CONV logEvent(const void *, void *, int, const uint16_t *) {
+	onLibraryThread();
+	events++;
+}
+
+void CALL_CONV locoEvent(const void *, void *, uint16_t) {
+	onLibraryThread();
+	events++;
+}
+
+void CALL_CONV msgEvent(const void *, void *, const uint16_t *) {
+	onLibraryThread();
+	events++;
+}
+
+// Message of LI or command station answering 'data' (without XOR)
+std::vector<uint8_t> answer(const uint8_t *data, size_t len) {
+	if ((len >= 1) && (data[0] == 0xF0))
+		return {0x02, 0x30, 0x40}; // LI version
+	if ((len >= 2) && (data[0] == 0xF2) && (data[1] == 0x01))
+		return {0xF2, 0x01, 0x01}; // LI address
+	if ((len >= 2) && (data[0] == 0x21) && (data[1] == 0x21))
+		return {0x63, 0x21, 0x36, 0x00}; // command station version
+	if ((len >= 2) && (data[0] == 0x21) && (data[1] == 0x24))
+		return {0x62, 0x22, 0x00}; // command station status
+	if ((len >= 2) && (data[0] == 0xE3) && (data[1] == 0x00))
+		return {0xE4, 0x04, 0x00, 0x00, 0x00}; // loco information
+	if ((len >= 2) && (data[0] == 0xE3) && (data[1] == 0x09))
+		return {0xE3, 0x52, 0x00, 0x00}; // functions F13-F28
+	return {0x01, 0x04}; // OK
+}
+
+// LI connected via LoopbackTransport, answers on the engine thread
+std::unique_ptr<Transport> simulatedLi() {
+	auto transport = std::make_unique<LoopbackTransport>();
+	LoopbackTransport *li = transport.get();
+	li->onWrite = [li](const uint8_t *data, size_t len) {
+		std::vector<uint8_t> reply;
+		if ((len >= 2) && (data[0] == 0xFF) && (data[1] == 0xFE)) { // LI-USB-Ethernet
+			reply = {0xFF, 0xFD};
+			data += 2;
+			len -= 2;
+		}
+		const std::vector<uint8_t> msg = answer(data, len);
+		uint8_t x = 0;
+		for (uint8_t byte : msg)
+			x ^= byte;
+		reply.insert(reply.end(), msg.begin(), msg.end());
+		reply.push_back(x);
+		li->inject(reply.data(), reply.size());
+	};
+	return transport;
+}
+
+void bindEvent(unsigned which) {
+	switch (which % 8) {
+	case 0: bindBeforeOpen(notifyEvent, nullptr); break;
+	case 1: bindAfterOpen(notifyEvent, nullptr); break;
+	case 2: bindBeforeClose(notifyEvent, nullptr); break;
+	case 3: bindAfterClose(notifyEvent, nullptr); break;
+	case 4: bindOnLog(logEvent, nullptr); break;
+	case 5: bindOnLocoStolen(locoEvent, nullptr); break;
+	case 6: bindOnOpenError(msgEvent, nullptr); break;
+	default: bindOnLog(nullptr, nullptr); break; // unbind
+	}
+}
+
+void worker(size_t id) {
+	std::mt19937 rng(static_cast<unsigned>(id));
+	const LibStdCallback cb {stdCallback, nullptr};
+
+	for (size_t i = 0; i < _ITERATIONS; i++) {
+		const uint16_t addr = static_cast<uint16_t>(1 + rng() % 50);
+		const unsigned op = rng() % 64;
+		if (op == 0) {
+			Xn::connect();
+		} else if (op == 1) {
+			Xn::disconnect();
+		} else if (op < 6) {
+			bindEvent(rng());
+		} else if (op < 30) {
+			locoSetSpeed(addr, static_cast<int>(rng() % 29), rng() % 2, cb, cb);
+		} else if (op < 46) {
+			locoSetFunc(addr, 1u << (rng() % 29), rng(), cb, cb);
+		} else if (op < 54) {
+			locoAcquire(addr, acquiredCallback, cb);
+		} else {
+			LibMetrics metrics;
+			engineMetrics(&metrics);
+			(void)Xn::connected();
+			(void)trackStatus();
+		}
+	}
+	workersRunning--;
+}
+
+void runEventLoop(int ms) {
+	QElapsedTimer timer;
+	timer.start();
+	while (timer.elapsed() < ms)
+		QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+}
+
+} // namespace
+
+int main() {
+	libraryThread = std::this_thread::get_id(); // library loaded by static initialization
+
+	// Adaptive pacing: commands are paced by response time of the simulated LI
+	std::FILE *config = std::fopen(_CONFIG_FILENAME.toStdString().c_str(), "w");
+	if (config == nullptr) {
+		std::fprintf(stderr, "Unable to write %s\n", _CONFIG_FILENAME.toStdString().c_str());
+		return 1;
+	}
+	std::fprintf(config, "[XN]\noutIntervalMs=50\npacing=adaptive\n");
+	std::fclose(config);
+	std::u16string filename = _CONFIG_FILENAME.toStdU16String();
+	loadConfig(&filename[0]);
+
+	if (!lib.engine.running()) {
+		std::fprintf(stderr, "Engine thread not running!\n");
+		return 1;
+	}
+	bool adaptive = false;
+	lib.engine.call([&adaptive](XpressNet &xn) { adaptive = (xn.config().pacing == PacingMode::Adaptive); });
+	if (!adaptive) {
+		std::fprintf(stderr, "Config %s rejected!\n", _CONFIG_FILENAME.toStdString().c_str());
+		return 1;
+	}
+	lib.transportFactory = simulatedLi;
+	Xn::connect();
+
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < _THREADS; i++)
+		workers.emplace_back(worker, i);
+	while (workersRunning > 0)
+		QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+	for (std::thread &thread : workers)
+		thread.join();
+
+	Xn::disconnect();
+	runEventLoop(500); // callbacks & events still in the host queue
+
+	std::printf("{\"threads\": %zu, \"iterations\": %zu, \"callbacks\": %zu, \"acquired\": %zu, "
+	            "\"events\": %zu, \"wrong_thread\": %zu}\n",
+	            _THREADS, _ITERATIONS, callbacks, acquired, events, wrongThread.load());
+	if ((callbacks == 0) || (acquired == 0)) {
+		std::fprintf(stderr, "No command answered by the simulated LI!\n");
+		return 1;
+	}
+	return (wrongThread == 0) ? 0 : 1;
+}
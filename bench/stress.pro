@@ -0,0 +1,67 @@
+TARGET = xn-stress
+TEMPLATE = app
+DEFINES += QT_DEPRECATED_WARNINGS
+DEFINES += XN_SHARED_LIBRARY
+
+SOURCES += \
+	stress.cpp \
+	../xn.cpp \
+	../xn-api.cpp \
+	../xn-receive.cpp \
+	../xn-send.cpp \
+	../xn-pending.cpp \
+	../xn-trace.cpp \
+	../xn-transport.cpp \
+	../xn-engine-thread.cpp \
+	../xn-win-com-discover.cpp \
+	../lib-api.cpp \
+	../lib-main.cpp \
+	../settings.cpp \
+	../config-window.cpp
+HEADERS += \
+	../xn.h \
+	../xn-loco-addr.h \
+	../xn-loco-cache.h \
+	../xn-feedback.h \
+	../xn-commands.h \
+	../xn-frame.h \
+	../xn-queue.h \
+	../xn-pacer.h \
+	../xn-metrics.h \
+	../xn-clock.h \
+	../xn-framer.h \
+	../xn-trace.h \
+	../xn-transport.h \
+	../xn-lockfree.h \
+	../xn-engine-thread.h \
+	../q-str-exception.h \
+	../xn-win-com-discover.h \
+	../lib-api.h \
+	../lib-main.h \
+	../lib-events.h \
+	../lib-api-common-def.h \
+	../settings.h \
+	../lib-errors.h
+
+FORMS += ../config-window.ui
+
+INCLUDEPATH += ..
+
+CONFIG += c++14 console
+CONFIG -= app_bundle
+QMAKE_CXXFLAGS += -Wall -Wextra -pedantic -O1 -g
+
+# qmake CONFIG+=tsan: build with ThreadSanitizer
+tsan {
+	QMAKE_CXXFLAGS += -fsanitize=thread
+	QMAKE_LFLAGS += -fsanitize=thread
+}
+
+win32 {
+	LIBS += -lsetupapi
+}
+
+QT += core gui serialport network
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+DEFINES += "VERSION_MAJOR=2" "VERSION_MINOR=9"
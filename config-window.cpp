@@ -31,6 +31,7 @@ void LibMain::guiInit() {
 }
 
 void LibMain::cb_interface_type_changed(int arg) {
+	std::lock_guard<std::recursive_mutex> lock(s_mutex);
 	this->cb_connections_changed(arg);
 	if ((s["XN"]["port"].toString() == "auto") && (form.ui.cb_interface_type->currentText() != "uLI"))
 		s["XN"]["port"] = "";
@@ -41,6 +42,7 @@ void LibMain::cb_connections_changed(int) {
 	if (this->gui_config_changing)
 		return;
 
+	std::lock_guard<std::recursive_mutex> lock(s_mutex);
 	s["XN"]["interface"] = form.ui.cb_interface_type->currentText();
 	s["XN"]["baudrate"] = form.ui.cb_serial_speed->currentText().toInt();
 	s["XN"]["flowcontrol"] = form.ui.cb_serial_flowcontrol->currentIndex();
@@ -50,6 +52,7 @@ void LibMain::cb_connections_changed(int) {
 }
 
 void LibMain::fillConnectionsCbs() {
+	std::lock_guard<std::recursive_mutex> lock(s_mutex);
 	this->gui_config_changing = true;
 
 	// Interface type
@@ -80,6 +83,7 @@ void LibMain::fillConnectionsCbs() {
 }
 
 void LibMain::fillPortCb() {
+	std::lock_guard<std::recursive_mutex> lock(s_mutex);
 	this->gui_config_changing = true;
 
 	form.ui.cb_serial_port->clear();
@@ -167,15 +171,17 @@ void LibMain::b_li_addr_set_handle() {
 	if (reply != QMessageBox::Yes)
 		return;
 
-	try {
-		xn.setLIAddress(
-			addr,
-			std::make_unique<Cb>([this](void *, void *) { userLiAddrSet(); }),
-			std::make_unique<Cb>([this](void *, void *) { userLiAddrSetErr(); })
-		);
-	} catch (const QStrException &e) {
-		userLiAddrSetErr();
-	}
+	engine.post([this, addr](XpressNet &xn) {
+		try {
+			xn.setLIAddress(
+				addr,
+				engine.onHost(std::make_unique<Cb>([this](void *, void *) { userLiAddrSet(); })),
+				engine.onHost(std::make_unique<Cb>([this](void *, void *) { userLiAddrSetErr(); }))
+			);
+		} catch (const QStrException &e) {
+			engine.toHost([this]() { userLiAddrSetErr(); });
+		}
+	});
 }
 
 } // namespace Xn
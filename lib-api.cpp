@@ -11,6 +11,16 @@ void callEv(void *sender, const LibStdCallback &callback) {
 		callback.func(sender, callback.data);
 }
 
+// Callbacks passed to XpressNet are called on the library thread
+UPCb hostCb(const LibStdCallback &callback) {
+	return lib.engine.onHost(std::make_unique<Cb>([callback](void *s, void *) { callEv(s, callback); }));
+}
+
+// Engine thread: calls 'callback' on the library thread
+void hostCallEv(const LibStdCallback &callback) {
+	lib.engine.toHost([callback]() { callEv(&lib.xn, callback); });
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // API
 
@@ -28,26 +38,28 @@ int apiSetVersion(unsigned int version) {
 }
 
 unsigned int features() {
-	return 0; // no features yet
+	return LIB_FEATURE_METRICS | LIB_FEATURE_BULK_ACQUIRE | LIB_FEATURE_FEEDBACK;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 // Config
 
 int loadConfig(char16_t *filename) {
-	if (lib.xn.connected())
+	if (lib.engine.connected())
 		return TRK_FILE_DEVICE_OPENED;
 	try {
+		std::lock_guard<std::recursive_mutex> lock(lib.s_mutex);
 		lib.config_filename = QString::fromUtf16(filename);
 		lib.s.load(lib.config_filename);
 		lib.xnSetConfig();
-		lib.fillConnectionsCbs();
+		lib.engine.runOnHost([]() { lib.fillConnectionsCbs(); });
 	} catch (...) { return TRK_FILE_CANNOT_ACCESS; }
 	return 0;
 }
 
 int saveConfig(char16_t *filename) {
 	try {
+		std::lock_guard<std::recursive_mutex> lock(lib.s_mutex);
 		lib.s.save(QString::fromUtf16(filename));
 	} catch (...) { return TRK_FILE_CANNOT_ACCESS; }
 	return 0;
@@ -57,101 +69,144 @@ int saveConfig(char16_t *filename) {
 // Connect / disconnect
 
 int connect() {
-	if (lib.xn.connected())
-		return TRK_ALREADY_OPENNED;
-
-	lib.events.call(lib.events.beforeOpen);
+	if (lib.engine.nestedCall()) {
+		lib.log("XN connect called from an event or callback of connect/disconnect!", LogLevel::Error);
+		return TRK_NESTED_CALL;
+	}
 
-	try {
-		lib.xn.connect(lib.s["XN"]["port"].toString(), lib.s["XN"]["baudrate"].toInt(),
-		               static_cast<QSerialPort::FlowControl>(lib.s["XN"]["flowcontrol"].toInt()),
-					   Xn::liInterface(lib.s["XN"]["interface"].toString()));
-	} catch (const Xn::QStrException &e) {
-		const QString errMsg = "XN connect error while opening serial port '" +
-			lib.s["XN"]["port"].toString() + "': " + e;
-		lib.log(errMsg, LogLevel::Error);
-		lib.events.call(lib.events.onOpenError, errMsg);
-		lib.events.call(lib.events.afterClose);
-		lib.guiOnClose();
-		return TRK_CANNOT_OPEN_PORT;
+	bool tcp, tcpPortOk;
+	QString host, tcpPort, port;
+	unsigned tcpPortNum;
+	int32_t baudrate;
+	QSerialPort::FlowControl flowcontrol;
+	LIType liType;
+	{
+		std::lock_guard<std::recursive_mutex> lock(lib.s_mutex);
+		tcp = (lib.s["XN"]["transport"].toString() == "tcp");
+		host = lib.s["XN"]["host"].toString();
+		tcpPort = lib.s["XN"]["tcpPort"].toString();
+		tcpPortNum = tcpPort.toUInt(&tcpPortOk);
+		tcpPortOk = tcpPortOk && (tcpPortNum > 0) && (tcpPortNum <= UINT16_MAX);
+		port = lib.s["XN"]["port"].toString();
+		baudrate = lib.s["XN"]["baudrate"].toInt();
+		flowcontrol = static_cast<QSerialPort::FlowControl>(lib.s["XN"]["flowcontrol"].toInt());
+		liType = Xn::liInterface(lib.s["XN"]["interface"].toString());
 	}
 
-	return 0;
+	int result = 0;
+	lib.engine.call([&](XpressNet &xn) {
+		if (xn.connected() || xn.connecting()) {
+			result = TRK_ALREADY_OPENNED;
+			return;
+		}
+
+		lib.engine.toHost([]() { lib.events.call(lib.events.beforeOpen); });
+
+		try {
+			if (tcp && !tcpPortOk)
+				throw EOpenError("'tcpPort' is not a valid port number!");
+			if (lib.transportFactory != nullptr)
+				xn.connect(lib.transportFactory(), liType);
+			else if (tcp)
+				xn.connectTcp(host, static_cast<uint16_t>(tcpPortNum)); // result by events
+			else
+				xn.connect(port, baudrate, flowcontrol, liType);
+		} catch (const Xn::QStrException &e) {
+			const QString errMsg = tcp
+				? "XN connect error while connecting to '" + host + ":" + tcpPort + "': " + e
+				: "XN connect error while opening serial port '" + port + "': " + e;
+			lib.engine.toHost([errMsg]() {
+				lib.log(errMsg, LogLevel::Error);
+				lib.events.call(lib.events.onOpenError, errMsg);
+				lib.events.call(lib.events.afterClose);
+				lib.guiOnClose();
+			});
+			result = TRK_CANNOT_OPEN_PORT;
+		}
+	});
+
+	return result;
 }
 
 int disconnect() {
-	lib.events.call(lib.events.beforeClose);
-
-	if (!lib.xn.connected())
-		return TRK_NOT_OPENED;
-
-	lib.opening = false;
-	try {
-		lib.xn.disconnect();
-	} catch (const Xn::QStrException &e) {
-		lib.log("XN disconnect error while closing serial port:" + e, LogLevel::Error);
+	if (lib.engine.nestedCall()) {
+		lib.log("XN disconnect called from an event or callback of connect/disconnect!",
+		        LogLevel::Error);
+		return TRK_NESTED_CALL;
 	}
 
-	return 0;
+	int result = 0;
+	lib.engine.call([&result](XpressNet &xn) {
+		lib.engine.toHost([]() {
+			lib.events.call(lib.events.beforeClose);
+			lib.opening = false;
+		});
+
+		if (!xn.connected() && !xn.connecting()) {
+			result = TRK_NOT_OPENED;
+			return;
+		}
+
+		try {
+			xn.disconnect();
+		} catch (const Xn::QStrException &e) {
+			lib.log("XN disconnect error while closing serial port:" + e, LogLevel::Error);
+		}
+	});
+
+	return result;
 }
 
 bool connected() {
-	return lib.xn.connected();
+	return lib.engine.connected();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
 int trackStatus() {
-	return static_cast<int>(lib.xn.getTrkStatus());
+	return static_cast<int>(lib.engine.trkStatus());
 }
 
 void setTrackStatus(unsigned int trkStatus, LibStdCallback ok, LibStdCallback err) {
-	try {
-		lib.xn.setTrkStatus(
-			static_cast<TrkStatus>(trkStatus),
-			std::make_unique<Cb>([ok](void *s, void *) { callEv(s, ok); }),
-			std::make_unique<Cb>([err](void *s, void *) { callEv(s, err); })
-		);
-	} catch (...) {
-		callEv(&lib.xn, err);
-	}
+	lib.engine.post([trkStatus, ok, err](XpressNet &xn) {
+		try {
+			xn.setTrkStatus(static_cast<TrkStatus>(trkStatus), hostCb(ok), hostCb(err));
+		} catch (...) {
+			hostCallEv(err);
+		}
+	});
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
 void emergencyStop(LibStdCallback ok, LibStdCallback err) {
-	try {
-		lib.xn.emergencyStop(
-			std::make_unique<Cb>([ok](void *s, void *) { callEv(s, ok); }),
-			std::make_unique<Cb>([err](void *s, void *) { callEv(s, err); })
-		);
-	} catch (...) {
-		callEv(&lib.xn, err);
-	}
+	lib.engine.post([ok, err](XpressNet &xn) {
+		try {
+			xn.emergencyStop(hostCb(ok), hostCb(err));
+		} catch (...) {
+			hostCallEv(err);
+		}
+	});
 }
 
 void locoEmergencyStop(uint16_t addr, LibStdCallback ok, LibStdCallback err) {
-	try {
-		lib.xn.emergencyStop(
-			LocoAddr(addr),
-			std::make_unique<Cb>([ok](void *s, void *) { callEv(s, ok); }),
-			std::make_unique<Cb>([err](void *s, void *) { callEv(s, err); })
-		);
-	} catch (...) {
-		callEv(&lib.xn, err);
-	}
+	lib.engine.post([addr, ok, err](XpressNet &xn) {
+		try {
+			xn.emergencyStop(LocoAddr(addr), hostCb(ok), hostCb(err));
+		} catch (...) {
+			hostCallEv(err);
+		}
+	});
 }
 
 void locoSetSpeed(uint16_t addr, int speed, bool dir, LibStdCallback ok, LibStdCallback err) {
-	try {
-		lib.xn.setSpeed(
-			LocoAddr(addr), speed, static_cast<Direction>(!dir),
-			std::make_unique<Cb>([ok](void *s, void *) { callEv(s, ok); }),
-			std::make_unique<Cb>([err](void *s, void *) { callEv(s, err); })
-		);
-	} catch (...) {
-		callEv(&lib.xn, err);
-	}
+	lib.engine.post([addr, speed, dir, ok, err](XpressNet &xn) {
+		try {
+			xn.setSpeed(LocoAddr(addr), speed, static_cast<Direction>(!dir), hostCb(ok), hostCb(err));
+		} catch (...) {
+			hostCallEv(err);
+		}
+	});
 }
 
 struct FuncToSet {
@@ -159,12 +214,13 @@ struct FuncToSet {
 	bool error = false;
 };
 
+// locoFuncSet & locoFuncSetErr are called on the engine thread
 void locoFuncSet(LibStdCallback ok, void *, void *data) {
 	auto *funcToSet = static_cast<FuncToSet *>(data);
 	funcToSet->setRemaining--;
 	if (funcToSet->setRemaining == 0) {
 		if (!funcToSet->error)
-			callEv(&lib.xn, ok);
+			hostCallEv(ok);
 		delete funcToSet;
 	}
 }
@@ -175,7 +231,7 @@ void locoFuncSetErr(LibStdCallback err, void *, void *data) {
 	funcToSet->error = true;
 	if (funcToSet->setRemaining == 0)
 		delete funcToSet;
-	callEv(&lib.xn, err);
+	hostCallEv(err);
 }
 
 void locoSetFunc(uint16_t addr, uint32_t funcMask, uint32_t funcState, LibStdCallback ok,
@@ -211,116 +267,133 @@ void locoSetFunc(uint16_t addr, uint32_t funcMask, uint32_t funcState, LibStdCal
 	if (setFd)
 		toSet->setRemaining++;
 
-	try {
-		LocoAddr laddr(addr);
-		if (setFa)
-			lib.xn.setFuncA(
-				laddr, fa,
-				std::make_unique<Cb>([ok](void *s, void *d) { locoFuncSet(ok, s, d); }, toSet),
-				std::make_unique<Cb>([err](void *s, void *d) { locoFuncSetErr(err, s, d); }, toSet)
-			);
-		if (setFb58)
-			lib.xn.setFuncB(
-				laddr, fb, FSet::F5toF8,
-				std::make_unique<Cb>([ok](void *s, void *d) { locoFuncSet(ok, s, d); }, toSet),
-				std::make_unique<Cb>([err](void *s, void *d) { locoFuncSetErr(err, s, d); }, toSet)
-			);
-		if (setFb912)
-			lib.xn.setFuncB(
-				laddr, fb, FSet::F9toF12,
-				std::make_unique<Cb>([ok](void *s, void *d) { locoFuncSet(ok, s, d); }, toSet),
-				std::make_unique<Cb>([err](void *s, void *d) { locoFuncSetErr(err, s, d); }, toSet)
-			);
-		if (setFc)
-			lib.xn.setFuncC(
-				laddr, fc,
-				std::make_unique<Cb>([ok](void *s, void *d) { locoFuncSet(ok, s, d); }, toSet),
-				std::make_unique<Cb>([err](void *s, void *d) { locoFuncSetErr(err, s, d); }, toSet)
-			);
-		if (setFd)
-			lib.xn.setFuncD(
-				laddr, fd,
-				std::make_unique<Cb>([ok](void *s, void *d) { locoFuncSet(ok, s, d); }, toSet),
-				std::make_unique<Cb>([err](void *s, void *d) { locoFuncSetErr(err, s, d); }, toSet)
-			);
-	} catch (...) {
-		callEv(&lib.xn, err);
-	}
+	lib.engine.post([=](XpressNet &xn) {
+		try {
+			LocoAddr laddr(addr);
+			if (setFa)
+				xn.setFuncA(
+					laddr, fa,
+					std::make_unique<Cb>([ok](void *s, void *d) { locoFuncSet(ok, s, d); }, toSet),
+					std::make_unique<Cb>([err](void *s, void *d) { locoFuncSetErr(err, s, d); }, toSet)
+				);
+			if (setFb58)
+				xn.setFuncB(
+					laddr, fb, FSet::F5toF8,
+					std::make_unique<Cb>([ok](void *s, void *d) { locoFuncSet(ok, s, d); }, toSet),
+					std::make_unique<Cb>([err](void *s, void *d) { locoFuncSetErr(err, s, d); }, toSet)
+				);
+			if (setFb912)
+				xn.setFuncB(
+					laddr, fb, FSet::F9toF12,
+					std::make_unique<Cb>([ok](void *s, void *d) { locoFuncSet(ok, s, d); }, toSet),
+					std::make_unique<Cb>([err](void *s, void *d) { locoFuncSetErr(err, s, d); }, toSet)
+				);
+			if (setFc)
+				xn.setFuncC(
+					laddr, fc,
+					std::make_unique<Cb>([ok](void *s, void *d) { locoFuncSet(ok, s, d); }, toSet),
+					std::make_unique<Cb>([err](void *s, void *d) { locoFuncSetErr(err, s, d); }, toSet)
+				);
+			if (setFd)
+				xn.setFuncD(
+					laddr, fd,
+					std::make_unique<Cb>([ok](void *s, void *d) { locoFuncSet(ok, s, d); }, toSet),
+					std::make_unique<Cb>([err](void *s, void *d) { locoFuncSetErr(err, s, d); }, toSet)
+				);
+		} catch (...) {
+			hostCallEv(err);
+		}
+	});
 }
 
-void locoAcquiredGotFunc(LocoInfo locoInfo, TrkAcquiredCallback acquired, void *, FC fc, FD fd) {
-	for (size_t i = 0; i < 8; i++)
-		if (fc.all & (1 << i))
-			locoInfo.functions |= (1 << (i+13));
-	for (size_t i = 0; i < 8; i++)
-		if (fd.all & (1 << i))
-			locoInfo.functions |= (1 << (i+21));
-
-	if (acquired != nullptr)
-		acquired(&lib.xn, locoInfo);
-}
-
-void locoAcquired(LocoAddr addr, TrkAcquiredCallback acquired, LibStdCallback err,
-                  void *, bool used, Direction direction, unsigned speed, FA fa, FB fb) {
+LocoInfo locoInfo(LocoAddr addr, const LocoState &state) {
 	LocoInfo locoInfo;
 	locoInfo.addr = addr.addr;
-	locoInfo.direction = !static_cast<bool>(direction);
-	locoInfo.speed = speed;
+	locoInfo.direction = !static_cast<bool>(state.direction);
+	locoInfo.speed = state.speed;
 	locoInfo.maxSpeed = 28;
-	locoInfo.usedByAnother = used;
+	locoInfo.usedByAnother = state.used;
 
 	locoInfo.functions = 0;
-	locoInfo.functions |= fa.sep.f0;
+	locoInfo.functions |= state.fa.sep.f0;
 	for (size_t i = 0; i < 4; i++)
-		if (fa.all & (1 << i))
+		if (state.fa.all & (1 << i))
 			locoInfo.functions |= (1 << (i+1));
 	for (size_t i = 0; i < 8; i++)
-		if (fb.all & (1 << i))
+		if (state.fb.all & (1 << i))
 			locoInfo.functions |= (1 << (i+5));
+	for (size_t i = 0; i < 8; i++)
+		if (state.fc.all & (1 << i))
+			locoInfo.functions |= (1 << (i+13));
+	for (size_t i = 0; i < 8; i++)
+		if (state.fd.all & (1 << i))
+			locoInfo.functions |= (1 << (i+21));
+	return locoInfo;
+}
 
-	try {
-		lib.xn.getLocoFunc1328(
-			addr,
-			[locoInfo, acquired](void *s, FC fc, FD fd) {
-				locoAcquiredGotFunc(locoInfo, acquired, s, fc, fd);
-			},
-			std::make_unique<Cb>([err](void *s, void *) { callEv(s, err); })
-		);
-	} catch (...) {
-		callEv(&lib.xn, err);
-	}
+// Engine thread: calls 'acquired' on the library thread
+GotLoco hostAcquired(TrkAcquiredCallback acquired) {
+	return [acquired](void *, LocoAddr addr, const LocoState &state) {
+		if (acquired != nullptr)
+			lib.engine.toHost([acquired, info = locoInfo(addr, state)]() { acquired(&lib.xn, info); });
+	};
 }
 
+// Information & function queries are answered from the loco cache when config
+// allows it (XNConfig::locoCache)
 void locoAcquire(uint16_t addr, TrkAcquiredCallback acquired, LibStdCallback err) {
-	try {
-		lib.xn.getLocoInfo(
-			LocoAddr(addr),
-			[addr, acquired, err](void *s, bool used, Direction direction, unsigned speed, FA fa,
-			                      FB fb) {
-				locoAcquired(LocoAddr(addr), acquired, err, s, used, direction, speed, fa, fb);
-			},
-			std::make_unique<Cb>([err](void *s, void *) { callEv(s, err); })
-		);
-	} catch (...) {
-		callEv(&lib.xn, err);
-	}
+	lib.engine.post([addr, acquired, err](XpressNet &xn) {
+		try {
+			xn.acquireLocos({LocoAddr(addr)}, hostAcquired(acquired),
+			                [err](void *, LocoAddr) { hostCallEv(err); });
+		} catch (...) {
+			hostCallEv(err);
+		}
+	});
+}
+
+void locosAcquire(const uint16_t *addrs, unsigned int count, TrkAcquiredCallback acquired,
+                  TrkLocoFailedCallback failed, LibStdCallback done) {
+	std::vector<uint16_t> all(addrs, addrs + count); // caller's array is not valid after return
+	lib.engine.post([all, acquired, failed, done](XpressNet &xn) {
+		LocoNotAcquired notAcquired = [failed](void *, LocoAddr addr) {
+			if (failed != nullptr)
+				lib.engine.toHost([failed, addr]() { failed(&lib.xn, addr.addr); });
+		};
+
+		std::vector<LocoAddr> locos;
+		locos.reserve(all.size());
+		for (uint16_t addr : all) {
+			try {
+				locos.emplace_back(addr);
+			} catch (const EInvalidAddr &) {
+				if (failed != nullptr)
+					lib.engine.toHost([failed, addr]() { failed(&lib.xn, addr); });
+			}
+		}
+
+		try {
+			xn.acquireLocos(locos, hostAcquired(acquired), notAcquired,
+			                [done](void *, size_t, size_t) { hostCallEv(done); });
+		} catch (...) {
+			hostCallEv(done);
+		}
+	});
 }
 
 void locoRelease(uint16_t addr, LibStdCallback ok) {
 	(void)addr;
-	callEv(&lib.xn, ok);
+	lib.engine.runOnHost([ok]() { callEv(&lib.xn, ok); });
 }
 
 void pomWriteCv(uint16_t addr, uint16_t cv, uint8_t value, LibStdCallback ok, LibStdCallback err) {
-	try {
-		lib.xn.pomWriteCv(
-			LocoAddr(addr), cv, value,
-			std::make_unique<Cb>([ok](void *s, void *) { callEv(s, ok); }),
-			std::make_unique<Cb>([err](void *s, void *) { callEv(s, err); })
-		);
-	} catch (...) {
-		callEv(&lib.xn, err);
-	}
+	lib.engine.post([addr, cv, value, ok, err](XpressNet &xn) {
+		try {
+			xn.pomWriteCv(LocoAddr(addr), cv, value, hostCb(ok), hostCb(err));
+		} catch (...) {
+			hostCallEv(err);
+		}
+	});
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -358,10 +431,110 @@ void bindOnOpenError(TrkMsgEv f, void *data) {
 	lib.events.bind(lib.events.onOpenError, f, data);
 }
 
+void bindOnFeedback(TrkFeedbackEv f, void *data) {
+	lib.events.bind(lib.events.onFeedback, f, data);
+}
+
+void bindOnMetrics(TrkMetricsEv f, void *data, unsigned int periodMs) {
+	lib.events.bind(lib.events.onMetrics, f, data);
+	lib.engine.runOnHost([f, periodMs]() { lib.metricsPeriod((f != nullptr) ? periodMs : 0); });
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 void showConfigDialog() {
-	lib.form.show();
+	lib.engine.runOnHost([]() { lib.form.show(); });
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Feedback: read directly, XpressNet writes the table lock-free on its thread
+
+static_assert(LIB_FEEDBACK_TABLE_SIZE == FeedbackTable::_NIBBLES,
+              "LIB_FEEDBACK_TABLE_SIZE does not match FeedbackTable");
+
+void feedbackTable(uint8_t *table) {
+	const FeedbackTable &feedback = lib.xn.feedback();
+	for (size_t i = 0; i < FeedbackTable::_WORDS; i++) {
+		const uint64_t word = feedback.word(i);
+		for (size_t j = 0; j < 8; j++)
+			table[8*i + j] = static_cast<uint8_t>(word >> (8*j));
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Metrics: read directly, XpressNet writes them lock-free on its thread
+
+static_assert(sizeof(LibCmdMetrics::retries)/sizeof(uint64_t) == _METRICS_RETRIES,
+              "LibCmdMetrics::retries does not match CmdMetrics::retries");
+static_assert(sizeof(LibMetrics::outDepth)/sizeof(uint32_t) == _CMD_PRIORITY_COUNT,
+              "LibMetrics::outDepth does not match lanes of outgoing queue");
+static_assert(sizeof(LibMetrics) == 96, "LibMetrics layout must not contain implicit padding");
+static_assert(sizeof(LibCmdMetrics) == 120, "LibCmdMetrics layout must not contain implicit padding");
+
+uint32_t clamp32(uint64_t value) {
+	return static_cast<uint32_t>(std::min<uint64_t>(value, UINT32_MAX));
+}
+
+void percentiles(const LatencyHistogram &histogram, uint32_t *result) {
+	const double qs[LIB_METRICS_PERCENTILES] = {0.5, 0.9, 0.99, 0.999, 1};
+	for (size_t i = 0; i < LIB_METRICS_PERCENTILES; i++)
+		result[i] = clamp32(histogram.percentile(qs[i]));
+}
+
+void engineMetrics(LibMetrics *metrics) {
+	const Metrics &all = lib.xn.metrics();
+	const EngineMetrics &engine = all.engine();
+	for (size_t i = 0; i < _CMD_PRIORITY_COUNT; i++)
+		metrics->outDepth[i] = clamp32(engine.outDepth[i].load(std::memory_order_relaxed));
+	metrics->inFlight = clamp32(engine.inFlight.load(std::memory_order_relaxed));
+	metrics->lastRttUs = clamp32(engine.lastRtt.load(std::memory_order_relaxed));
+	metrics->avgRttUs = clamp32(engine.avgRtt.load(std::memory_order_relaxed));
+	metrics->reserved = 0;
+	metrics->pacingRate = engine.pacingRate.load(std::memory_order_relaxed) / 1000.0;
+	metrics->framesSent = engine.framesSent.load(std::memory_order_relaxed);
+	metrics->bytesSent = engine.bytesSent.load(std::memory_order_relaxed);
+	metrics->framesReceived = all.receive().frames.load(std::memory_order_relaxed);
+	metrics->bytesReceived = engine.bytesReceived.load(std::memory_order_relaxed);
+	metrics->retransmissions = all.total(&CmdMetrics::retransmissions);
+	metrics->timeouts = all.total(&CmdMetrics::timeouts);
+	metrics->errors = all.total(&CmdMetrics::errors);
+}
+
+const char *cmdMetricsName(unsigned int cmdType) {
+	if (cmdType >= _CMD_TYPE_COUNT)
+		return nullptr;
+	return cmdTypeName(static_cast<CmdType>(cmdType));
+}
+
+int cmdMetrics(unsigned int cmdType, LibCmdMetrics *metrics) {
+	if (cmdType >= _CMD_TYPE_COUNT)
+		return TRK_UNKNOWN_CMD_TYPE;
+
+	const CmdMetrics &cmd = lib.xn.metrics().cmd(static_cast<CmdType>(cmdType));
+	metrics->sent = cmd.sent.load(std::memory_order_relaxed);
+	metrics->retransmissions = cmd.retransmissions.load(std::memory_order_relaxed);
+	metrics->responses = cmd.responses.load(std::memory_order_relaxed);
+	metrics->errors = cmd.errors.load(std::memory_order_relaxed);
+	metrics->timeouts = cmd.timeouts.load(std::memory_order_relaxed);
+	metrics->conflictDeferrals = cmd.conflictDeferrals.load(std::memory_order_relaxed);
+	for (size_t i = 0; i < _METRICS_RETRIES; i++)
+		metrics->retries[i] = cmd.retries[i].load(std::memory_order_relaxed);
+	percentiles(cmd.queued, metrics->queuedUs);
+	percentiles(cmd.rtt, metrics->rttUs);
+	return 0;
+}
+
+void receiveMetrics(LibReceiveMetrics *metrics) {
+	const ReceiveMetrics &receive = lib.xn.metrics().receive();
+	metrics->frames = receive.frames.load(std::memory_order_relaxed);
+	metrics->xorErrors = receive.xorErrors.load(std::memory_order_relaxed);
+	metrics->resyncBytes = receive.resyncBytes.load(std::memory_order_relaxed);
+	metrics->overflows = receive.overflows.load(std::memory_order_relaxed);
+	metrics->timeouts = receive.timeouts.load(std::memory_order_relaxed);
+}
+
+void metricsReset() {
+	lib.engine.post([](XpressNet &xn) { xn.metricsReset(); });
 }
 
 ///////////////////////////////////////////////////////////////////////////////
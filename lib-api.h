@@ -12,6 +12,9 @@ constexpr std::array<unsigned int, 3> API_SUPPORTED_VERSIONS {
 	0x0001, 0x0100, 0x0101 // v0.1, v1.0, v1.1
 };
 
+// Exported functions could be called from any thread, callbacks are called on
+// the library thread (see lib-main.h).
+
 extern "C" {
 
 using LibCallbackFunc = void CALL_CONV (*) (void *sender, void *data);
@@ -31,6 +34,63 @@ struct LocoInfo {
 };
 
 using TrkAcquiredCallback = void CALL_CONV (*)(const void *sender, LocoInfo);
+using TrkLocoFailedCallback = void CALL_CONV (*)(const void *sender, uint16_t addr);
+
+// Bits of 'features()'
+constexpr unsigned int LIB_FEATURE_METRICS = 0x01; // engineMetrics, cmdMetrics & bindOnMetrics
+constexpr unsigned int LIB_FEATURE_BULK_ACQUIRE = 0x02; // locosAcquire
+constexpr unsigned int LIB_FEATURE_FEEDBACK = 0x04; // bindOnFeedback & feedbackTable
+
+constexpr unsigned int LIB_FEEDBACK_TABLE_SIZE = 512; // 256 groups x 2 nibbles
+
+// Changed nibble of feedback (accessory decoder or feedback module)
+struct LibAccInputChange {
+	uint8_t groupAddr;
+	bool nibble; // false = inputs 0-3, true = inputs 4-7
+	bool error;
+	uint8_t inputType; // 0 = accessory w/o feedback, 1 = accessory with feedback, 2 = feedback module
+	uint8_t inputs; // bits 0-3
+};
+
+constexpr unsigned int LIB_METRICS_PERCENTILES = 5; // p50, p90, p99, p99.9, max
+
+// Metrics of a command type since library load or 'metricsReset' (see xn-metrics.h)
+struct LibCmdMetrics {
+	uint64_t sent; // first transmissions
+	uint64_t retransmissions;
+	uint64_t responses;
+	uint64_t errors;
+	uint64_t timeouts; // no response after all transmissions
+	uint64_t conflictDeferrals; // queued because of conflict with a pending command
+	uint64_t retries[4]; // finished commands with 0, 1, 2, 3+ retries
+	uint32_t queuedUs[LIB_METRICS_PERCENTILES]; // time in the outgoing queue
+	uint32_t rttUs[LIB_METRICS_PERCENTILES]; // time from the last transmission to the response
+};
+
+// Snapshot of the engine state
+struct LibMetrics {
+	uint32_t outDepth[4]; // commands waiting in lanes: safety, control, operation, query
+	uint32_t inFlight; // commands sent with no response yet
+	uint32_t lastRttUs; // response time of the last answered command
+	uint32_t avgRttUs; // moving average of response time used by pacing
+	uint32_t reserved; // explicit padding, always 0
+	double pacingRate; // frames per second currently allowed by pacing
+	uint64_t framesSent;
+	uint64_t bytesSent;
+	uint64_t framesReceived;
+	uint64_t bytesReceived;
+	uint64_t retransmissions; // totals over all command types
+	uint64_t timeouts;
+	uint64_t errors;
+};
+
+struct LibReceiveMetrics {
+	uint64_t frames;
+	uint64_t xorErrors;
+	uint64_t resyncBytes; // bytes skipped when looking for a valid frame
+	uint64_t overflows;
+	uint64_t timeouts; // incomplete frames dropped
+};
 
 XN_SHARED_EXPORT bool CALL_CONV apiSupportsVersion(unsigned int version);
 XN_SHARED_EXPORT int CALL_CONV apiSetVersion(unsigned int version);
@@ -56,6 +116,11 @@ XN_SHARED_EXPORT void CALL_CONV locoSetFunc(uint16_t addr, uint32_t funcMask, ui
                                             LibStdCallback ok, LibStdCallback err);
 XN_SHARED_EXPORT void CALL_CONV locoAcquire(uint16_t addr, TrkAcquiredCallback,
                                             LibStdCallback err);
+// Acquires all 'addrs' at once: 'acquired' or 'failed' is called for each loco as
+// soon as it is acquired, 'done' after all of them.
+XN_SHARED_EXPORT void CALL_CONV locosAcquire(const uint16_t *addrs, unsigned int count,
+                                             TrkAcquiredCallback acquired,
+                                             TrkLocoFailedCallback failed, LibStdCallback done);
 XN_SHARED_EXPORT void CALL_CONV locoRelease(uint16_t addr, LibStdCallback ok);
 
 XN_SHARED_EXPORT void CALL_CONV pomWriteCv(uint16_t addr, uint16_t cv, uint8_t value,
@@ -69,9 +134,25 @@ XN_SHARED_EXPORT void CALL_CONV bindOnTrackStatusChange(TrkStatusChangedEv f, vo
 XN_SHARED_EXPORT void CALL_CONV bindOnLog(TrkLogEv f, void *data);
 XN_SHARED_EXPORT void CALL_CONV bindOnLocoStolen(TrkLocoEv f, void *data);
 XN_SHARED_EXPORT void CALL_CONV bindOnOpenError(TrkMsgEv f, void *data);
+// Changed inputs in batches: per received frame or per [XN] feedbackWindowMs
+XN_SHARED_EXPORT void CALL_CONV bindOnFeedback(TrkFeedbackEv f, void *data);
+// Calls 'f' with engineMetrics snapshot every 'periodMs' ms, 0 = stop
+XN_SHARED_EXPORT void CALL_CONV bindOnMetrics(TrkMetricsEv f, void *data, unsigned int periodMs);
 
 XN_SHARED_EXPORT void CALL_CONV showConfigDialog();
 
+// Any thread: copies state of all feedback nibbles, byte 2*groupAddr + nibble:
+// bits 0-3 inputs, bit 4 known, bits 5-6 input type, bit 7 error
+XN_SHARED_EXPORT void CALL_CONV feedbackTable(uint8_t *table); // LIB_FEEDBACK_TABLE_SIZE bytes
+
+// Metrics could be read from any thread at any rate, no locks are taken.
+// cmdType: Xn::CmdType, cmdMetricsName returns nullptr for unknown type.
+XN_SHARED_EXPORT void CALL_CONV engineMetrics(LibMetrics *metrics);
+XN_SHARED_EXPORT const char *CALL_CONV cmdMetricsName(unsigned int cmdType);
+XN_SHARED_EXPORT int CALL_CONV cmdMetrics(unsigned int cmdType, LibCmdMetrics *metrics);
+XN_SHARED_EXPORT void CALL_CONV receiveMetrics(LibReceiveMetrics *metrics);
+XN_SHARED_EXPORT void CALL_CONV metricsReset();
+
 }
 
 } // namespace Xn
@@ -7,5 +7,7 @@ constexpr int TRK_ALREADY_OPENNED = 2001;
 constexpr int TRK_CANNOT_OPEN_PORT = 2002;
 constexpr int TRK_NOT_OPENED = 2011;
 constexpr int TRK_UNSUPPORTED_API_VERSION = 4000;
+constexpr int TRK_UNKNOWN_CMD_TYPE = 4010;
+constexpr int TRK_NESTED_CALL = 4020; // connect/disconnect from an event or callback
 
 #endif
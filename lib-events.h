@@ -3,21 +3,30 @@
 
 #include <QString>
 #include <cstdint>
+#include <mutex>
 
 #include "lib-api-common-def.h"
 #include "xn.h"
 
 /* This file provides storage & calling capabilities of callbacks from the
  * library back to the hJOPserver.
+ * Events could be bound from any thread, they are called on the library thread
+ * (see lib-main.h).
  */
 
 namespace Xn {
 
+struct LibMetrics; // lib-api.h
+struct LibAccInputChange; // lib-api.h
+
 using TrkStdNotifyEvent = void CALL_CONV (*)(const void *sender, void *data);
 using TrkStatusChangedEv = void CALL_CONV (*)(const void *sender, void *data, int trkStatus);
 using TrkLogEv = void CALL_CONV (*)(const void *sender, void *data, int loglevel, const uint16_t *msg);
 using TrkLocoEv = void CALL_CONV (*)(const void *sender, void *data, uint16_t addr);
 using TrkMsgEv = void CALL_CONV (*)(const void *sender, void *data, const uint16_t *msg);
+using TrkMetricsEv = void CALL_CONV (*)(const void *sender, void *data, const LibMetrics *metrics);
+using TrkFeedbackEv = void CALL_CONV (*)(const void *sender, void *data,
+                                         const LibAccInputChange *changes, unsigned int count);
 
 template <typename F>
 struct EventData {
@@ -36,32 +45,61 @@ struct XnEvents {
 	EventData<TrkStatusChangedEv> onTrkStatusChanged;
 	EventData<TrkLocoEv> onLocoStolen;
 	EventData<TrkMsgEv> onOpenError;
+	EventData<TrkMetricsEv> onMetrics;
+	EventData<TrkFeedbackEv> onFeedback;
 
-	void call(const EventData<TrkStdNotifyEvent> &e) const {
+	void call(const EventData<TrkStdNotifyEvent> &event) const {
+		const auto e = get(event);
 		if (e.defined())
 			e.func(this, e.data);
 	}
-	void call(const EventData<TrkLogEv> &e, LogLevel loglevel, const QString &msg) const {
+	void call(const EventData<TrkLogEv> &event, LogLevel loglevel, const QString &msg) const {
+		const auto e = get(event);
 		if (e.defined())
 			e.func(this, e.data, static_cast<int>(loglevel), msg.utf16());
 	}
-	void call(const EventData<TrkStatusChangedEv> &e, TrkStatus status) const {
+	void call(const EventData<TrkStatusChangedEv> &event, TrkStatus status) const {
+		const auto e = get(event);
 		if (e.defined())
 			e.func(this, e.data, static_cast<int>(status));
 	}
-	void call(const EventData<TrkLocoEv> &e, LocoAddr addr) const {
+	void call(const EventData<TrkLocoEv> &event, LocoAddr addr) const {
+		const auto e = get(event);
 		if (e.defined())
 			e.func(this, e.data, addr.addr);
 	}
-	void call(const EventData<TrkMsgEv> &e, const QString &msg) const {
+	void call(const EventData<TrkMsgEv> &event, const QString &msg) const {
+		const auto e = get(event);
 		if (e.defined())
 			e.func(this, e.data, msg.utf16());
 	}
+	void call(const EventData<TrkMetricsEv> &event, const LibMetrics &metrics) const {
+		const auto e = get(event);
+		if (e.defined())
+			e.func(this, e.data, &metrics);
+	}
+	void call(const EventData<TrkFeedbackEv> &event, const LibAccInputChange *changes,
+	          size_t count) const {
+		const auto e = get(event);
+		if (e.defined())
+			e.func(this, e.data, changes, static_cast<unsigned int>(count));
+	}
 	template <typename F>
-	static void bind(EventData<F> &event, const F &func, void *const data) {
+	void bind(EventData<F> &event, const F &func, void *const data) {
+		std::lock_guard<std::mutex> lock(m_mutex);
 		event.func = func;
 		event.data = data;
 	}
+
+private:
+	mutable std::mutex m_mutex;
+
+	// Copy under lock, event is called without lock (it could bind events)
+	template <typename F>
+	EventData<F> get(const EventData<F> &event) const {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return event;
+	}
 };
 
 } // namespace Xn
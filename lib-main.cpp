@@ -1,4 +1,5 @@
 #include "lib-main.h"
+#include "lib-api.h"
 
 namespace Xn {
 
@@ -7,29 +8,41 @@ LibMain lib(nullptr);
 
 ///////////////////////////////////////////////////////////////////////////////
 
-LibMain::LibMain(QObject* parent) : QObject(parent) {
-	xn.loglevel = LogLevel::Debug;
-
-	QObject::connect(&xn, SIGNAL(onError(QString)), this, SLOT(xnOnError(QString)));
-	QObject::connect(&xn, SIGNAL(onLog(QString, Xn::LogLevel)), this,
+LibMain::LibMain(QObject* parent) : QObject(parent), engine(xn) {
+	// XpressNet events come through engine, so they are called on the library thread
+	QObject::connect(&engine, SIGNAL(onError(QString)), this, SLOT(xnOnError(QString)));
+	QObject::connect(&engine, SIGNAL(onLog(QString, Xn::LogLevel)), this,
 	                 SLOT(xnOnLog(QString, Xn::LogLevel)));
-	QObject::connect(&xn, SIGNAL(onConnect()), this, SLOT(xnOnConnect()));
-	QObject::connect(&xn, SIGNAL(onDisconnect()), this, SLOT(xnOnDisconnect()));
-	QObject::connect(&xn, SIGNAL(onLocoStolen(Xn::LocoAddr)), this, SLOT(xnOnLocoStolen(Xn::LocoAddr)));
-	QObject::connect(&xn, SIGNAL(onTrkStatusChanged(Xn::TrkStatus)), this,
+	QObject::connect(&engine, SIGNAL(onConnect()), this, SLOT(xnOnConnect()));
+	QObject::connect(&engine, SIGNAL(onConnectError(QString)), this, SLOT(xnOnConnectError(QString)));
+	QObject::connect(&engine, SIGNAL(onDisconnect()), this, SLOT(xnOnDisconnect()));
+	QObject::connect(&engine, SIGNAL(onLocoStolen(Xn::LocoAddr)), this,
+	                 SLOT(xnOnLocoStolen(Xn::LocoAddr)));
+	QObject::connect(&engine, SIGNAL(onTrkStatusChanged(Xn::TrkStatus)), this,
 	                 SLOT(xnOnTrkStatusChanged(Xn::TrkStatus)));
+	QObject::connect(&engine, SIGNAL(onAccInputsChanged(Xn::AccInputChanges)), this,
+	                 SLOT(xnOnAccInputsChanged(Xn::AccInputChanges)));
+	QObject::connect(&metrics_timer, SIGNAL(timeout()), this, SLOT(metricsTick()));
 
 	this->config_filename = _DEFAULT_CONFIG_FILENAME;
 	s.load(this->config_filename);
 	this->xnSetConfig();
 	this->guiInit();
-	log("Library loaded.", LogLevel::Info);
+
+	if (s["XN"]["engineThread"].toBool()) {
+		engine.start();
+		log("Library loaded, engine thread started.", LogLevel::Info);
+	} else {
+		log("Library loaded.", LogLevel::Info);
+	}
 }
 
 LibMain::~LibMain() {
 	try {
+		engine.stop(); // disconnects
 		if (xn.connected())
 			xn.disconnect();
+		std::lock_guard<std::recursive_mutex> lock(s_mutex);
 		if (this->config_filename != "")
 			this->s.save(this->config_filename);
 	} catch (...) {
@@ -40,7 +53,27 @@ LibMain::~LibMain() {
 ///////////////////////////////////////////////////////////////////////////////
 
 void LibMain::log(const QString &msg, LogLevel loglevel) {
-	events.call(events.onLog, loglevel, msg);
+	engine.runOnHost([this, msg, loglevel]() { events.call(events.onLog, loglevel, msg); });
+}
+
+void LibMain::metricsPeriod(unsigned int ms) {
+	if (ms > 0)
+		metrics_timer.start(static_cast<int>(ms));
+	else
+		metrics_timer.stop();
+}
+
+void LibMain::metricsTick() {
+	LibMetrics metrics;
+	engineMetrics(&metrics);
+	this->events.call(this->events.onMetrics, metrics);
+}
+
+void LibMain::xnDisconnect() {
+	engine.post([](XpressNet &xn) {
+		if (xn.connected())
+			xn.disconnect();
+	});
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -56,8 +89,7 @@ void LibMain::xnOnLog(QString message, LogLevel loglevel) {
 void LibMain::xnOnError(QString error) {
 	// Xn error is considered fatal -> close device
 	log("XN error: " + error, LogLevel::Error);
-	if (xn.connected())
-		xn.disconnect();
+	this->xnDisconnect();
 }
 
 void LibMain::xnOnConnect() {
@@ -66,6 +98,15 @@ void LibMain::xnOnConnect() {
 	this->getLIVersion();
 }
 
+void LibMain::xnOnConnectError(QString error) {
+	// Asynchronous connect (TCP) failed after 'connect' returned
+	const QString errMsg = "XN connect error: " + error;
+	log(errMsg, LogLevel::Error);
+	this->events.call(this->events.onOpenError, errMsg);
+	this->events.call(this->events.afterClose);
+	this->guiOnClose();
+}
+
 void LibMain::xnOnDisconnect() {
 	this->opening = false;
 	this->guiOnClose();
@@ -76,6 +117,15 @@ void LibMain::xnOnLocoStolen(LocoAddr addr) {
 	this->events.call(this->events.onLocoStolen, addr);
 }
 
+void LibMain::xnOnAccInputsChanged(AccInputChanges changes) {
+	std::vector<LibAccInputChange> libChanges;
+	libChanges.reserve(changes.size());
+	for (const AccInputChange &change : changes)
+		libChanges.push_back({change.groupAddr, change.nibble, change.error,
+		                      static_cast<uint8_t>(change.inputType), change.state.all});
+	this->events.call(this->events.onFeedback, libChanges.data(), libChanges.size());
+}
+
 void LibMain::xnOnTrkStatusChanged(TrkStatus trkStatus) {
 	this->events.call(this->events.onTrkStatusChanged, trkStatus);
 
@@ -86,16 +136,26 @@ void LibMain::xnOnTrkStatusChanged(TrkStatus trkStatus) {
 }
 
 void LibMain::getLIVersion() {
-	try {
-		xn.getLIVersion(
-			[this](void *s, unsigned hw, unsigned sw) { xnGotLIVersion(s, hw, sw); },
-			std::make_unique<Cb>([this](void *s, void *d) { xnOnLIVersionError(s, d); })
-		);
-	} catch (const QStrException &e) {
-		log("Get LI Version: " + e.str(), LogLevel::Error);
-		events.call(events.onOpenError, "Get LI Version: " + e.str());
-		xn.disconnect();
-	}
+	engine.post([this](XpressNet &xn) {
+		try {
+			xn.getLIVersion(
+				engine.onHost(GotLIVersion([this](void *s, unsigned hw, unsigned sw) {
+					xnGotLIVersion(s, hw, sw);
+				})),
+				engine.onHost(std::make_unique<Cb>([this](void *s, void *d) { xnOnLIVersionError(s, d); }))
+			);
+		} catch (const QStrException &e) {
+			this->openError("Get LI Version: " + e.str());
+		}
+	});
+}
+
+void LibMain::openError(const QString &message) {
+	engine.runOnHost([this, message]() {
+		log(message, LogLevel::Error);
+		events.call(events.onOpenError, message);
+		this->xnDisconnect();
+	});
 }
 
 void LibMain::xnGotLIVersion(void *, unsigned hw, unsigned sw) {
@@ -106,22 +166,20 @@ void LibMain::xnGotLIVersion(void *, unsigned hw, unsigned sw) {
 	form.ui.l_li_version->setText(version);
 	form.ui.l_info_datetime->setText(QTime::currentTime().toString("hh:mm:ss"));
 
-	try {
-		xn.getLIAddress(
-			[this](void *s, unsigned addr) { xnGotLIAddress(s, addr); },
-			std::make_unique<Cb>([this](void *s, void *d) { xnOnLIAddrError(s, d); })
-		);
-	} catch (const QStrException &e) {
-		log("Get LI Address: " + e.str(), LogLevel::Error);
-		events.call(events.onOpenError, "Get LI Address: " + e.str());
-		xn.disconnect();
-	}
+	engine.post([this](XpressNet &xn) {
+		try {
+			xn.getLIAddress(
+				engine.onHost(GotLIAddress([this](void *s, unsigned addr) { xnGotLIAddress(s, addr); })),
+				engine.onHost(std::make_unique<Cb>([this](void *s, void *d) { xnOnLIAddrError(s, d); }))
+			);
+		} catch (const QStrException &e) {
+			this->openError("Get LI Address: " + e.str());
+		}
+	});
 }
 
 void LibMain::xnOnLIVersionError(void *, void *) {
-	log("Get LI Version: no response!", LogLevel::Error);
-	events.call(events.onOpenError, "Get LI Version: no response!");
-	xn.disconnect();
+	this->openError("Get LI Version: no response!");
 }
 
 void LibMain::xnGotLIAddress(void *, unsigned addr) {
@@ -137,18 +195,18 @@ void LibMain::xnOnLIAddrError(void *, void *) {
 }
 
 void LibMain::getCSVersion() {
-	try {
-		xn.getCommandStationVersion(
-			[this](void *s, unsigned major, unsigned minor, uint8_t id) {
-				xnGotCSVersion(s, major, minor, id);
-			},
-			std::make_unique<Cb>([this](void *s, void *d) { xnOnCsVersionError(s, d); })
-		);
-	} catch (const QStrException &e) {
-		log("Get CS Version: " + e.str(), LogLevel::Error);
-		events.call(events.onOpenError, "Get CS Version: " + e.str());
-		xn.disconnect();
-	}
+	engine.post([this](XpressNet &xn) {
+		try {
+			xn.getCommandStationVersion(
+				engine.onHost(GotCSVersion([this](void *s, unsigned major, unsigned minor, uint8_t id) {
+					xnGotCSVersion(s, major, minor, id);
+				})),
+				engine.onHost(std::make_unique<Cb>([this](void *s, void *d) { xnOnCsVersionError(s, d); }))
+			);
+		} catch (const QStrException &e) {
+			this->openError("Get CS Version: " + e.str());
+		}
+	});
 }
 
 void LibMain::xnGotCSVersion(void *, unsigned major, unsigned minor, uint8_t id) {
@@ -168,35 +226,77 @@ void LibMain::xnOnCsVersionError(void *, void *) {
 }
 
 void LibMain::getCSStatus() {
-	try {
-		xn.getCommandStationStatus(
-			nullptr,
-			std::make_unique<Cb>([this](void *s, void *d) { xnOnCSStatusError(s, d); })
-		);
-	} catch (const QStrException &e) {
-		log("Get CS Status: " + e.str(), LogLevel::Error);
-		events.call(events.onOpenError, "Get CS Status: " + e.str());
-		xn.disconnect();
-	}
+	engine.post([this](XpressNet &xn) {
+		try {
+			xn.getCommandStationStatus(
+				nullptr,
+				engine.onHost(std::make_unique<Cb>([this](void *s, void *d) { xnOnCSStatusError(s, d); }))
+			);
+		} catch (const QStrException &e) {
+			this->openError("Get CS Status: " + e.str());
+		}
+	});
 }
 
 void LibMain::xnOnCSStatusError(void *, void *) {
-	log("Get CS Status: no response!", LogLevel::Error);
-	events.call(events.onOpenError, "Get CS Status: no response!");
-	xn.disconnect();
+	this->openError("Get CS Status: no response!");
 }
 
 void LibMain::xnSetConfig() {
+	std::lock_guard<std::recursive_mutex> lock(s_mutex);
 	try {
 		XNConfig config;
 		bool ok;
+		unsigned loglevelNum = s["XN"]["loglevel"].toUInt(&ok);
+		if ((!ok) || (loglevelNum > static_cast<unsigned>(LogLevel::Debug))) {
+			loglevelNum = DEFAULTS.at("XN").at("loglevel").toUInt(); // same as missing key
+			log("xnConfig: invalid 'loglevel', using "+QString::number(loglevelNum)+"!",
+			    LogLevel::Warning);
+		}
+		const LogLevel loglevel = static_cast<LogLevel>(loglevelNum);
+		engine.post([loglevel](XpressNet &xn) { xn.loglevel = loglevel; });
+
 		config.outInterval = s["XN"]["outIntervalMs"].toUInt(&ok);
 		if (!ok) {
 			log("Unable to load xnConfig: 'outIntervalMs' is not a number!", LogLevel::Error);
 			return;
 		}
+		config.pacing = pacingMode(s["XN"]["pacing"].toString());
+		config.pacingBurst = s["XN"]["pacingBurstMs"].toUInt(&ok);
+		if (!ok) {
+			log("Unable to load xnConfig: 'pacingBurstMs' is not a number!", LogLevel::Error);
+			return;
+		}
+		config.pendingMax = s["XN"]["pendingMax"].toUInt(&ok);
+		if (!ok) {
+			log("Unable to load xnConfig: 'pendingMax' is not a number!", LogLevel::Error);
+			return;
+		}
+		config.readBufferSize = s["XN"]["readBufferSize"].toUInt(&ok);
+		if (!ok) {
+			log("Unable to load xnConfig: 'readBufferSize' is not a number!", LogLevel::Error);
+			return;
+		}
+		config.coalesce = s["XN"]["coalesce"].toBool();
+		config.locoCache = locoCachePolicy(s["XN"]["locoCache"].toString());
+		config.locoCacheMaxAge = s["XN"]["locoCacheMaxAgeMs"].toUInt(&ok);
+		if (!ok) {
+			log("Unable to load xnConfig: 'locoCacheMaxAgeMs' is not a number!", LogLevel::Error);
+			return;
+		}
+		config.feedbackWindow = s["XN"]["feedbackWindowMs"].toUInt(&ok);
+		if (!ok) {
+			log("Unable to load xnConfig: 'feedbackWindowMs' is not a number!", LogLevel::Error);
+			return;
+		}
 
-		xn.setConfig(config);
+		engine.post([this, config](XpressNet &xn) {
+			try {
+				xn.setConfig(config);
+			} catch (const QStrException& e) {
+				log("Unable to load xnConfig: "+e.str(), LogLevel::Error);
+			}
+		});
 	} catch (const QStrException& e) {
 		log("Unable to load xnConfig: "+e.str(), LogLevel::Error);
 	} catch (...) {
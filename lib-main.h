@@ -1,15 +1,34 @@
 #ifndef LIB_MAIN_H
 #define LIB_MAIN_H
 
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <QApplication>
 #include <QMainWindow>
+#include <QTimer>
 
 #include "ui_config-window.h"
 #include "xn.h"
+#include "xn-engine-thread.h"
 #include "lib-events.h"
 #include "settings.h"
 
+/* Threads of the dynamic library:
+ * - library thread: thread the library was loaded in (owns QApplication,
+ *   LibMain & config window). All callbacks & events are called here.
+ * - engine thread: runs XpressNet (see xn-engine-thread.h), when enabled by
+ *   [XN] engineThread (read on library load only).
+ * Exported functions could be called from any thread: they post work to the
+ * engine thread; 'connect' & 'disconnect' wait for it to be done. Called from
+ * the library thread, they deliver events & callbacks while waiting, so these
+ * run inside 'connect' & 'disconnect' and must not call them again
+ * (TRK_NESTED_CALL is returned, see EngineThread::call).
+ * With engineThread=false, XpressNet runs on the library thread & exported
+ * functions must be called from a single thread.
+ */
+
 namespace Xn {
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -27,14 +46,19 @@ class LibMain : public QObject {
 	Q_OBJECT
 public:
 	XpressNet xn;
+	EngineThread engine;
 	ConfigWindow form;
 	XnEvents events;
 	Settings s;
+	std::recursive_mutex s_mutex; // guards 's' & 'config_filename'
 	QString config_filename = "";
-	unsigned int api_version = 0x0001;
+	std::atomic<unsigned int> api_version{0x0001};
 	bool gui_config_changing = false;
 	bool opening = false;
 	unsigned int li_ver_hw = 0, li_ver_sw = 0;
+	QTimer metrics_timer; // pushes engineMetrics to onMetrics event
+	// Replaces transport of the config when set (stress test in bench/)
+	std::function<std::unique_ptr<Transport>()> transportFactory;
 
 	LibMain(QObject*);
 	~LibMain() override;
@@ -45,8 +69,10 @@ public:
 	void guiOnOpen();
 	void guiOnClose();
 
-	void log(const QString &msg, LogLevel loglevel);
-	void xnSetConfig();
+	void log(const QString &msg, LogLevel loglevel); // any thread
+	void xnSetConfig(); // any thread
+	void xnDisconnect(); // any thread
+	void metricsPeriod(unsigned int ms); // 0 = stop
 
 private slots:
 	void b_serial_refresh_handle();
@@ -58,9 +84,12 @@ private slots:
 	void xnOnLog(QString message, Xn::LogLevel loglevel);
 	void xnOnError(QString error);
 	void xnOnConnect();
+	void xnOnConnectError(QString error);
 	void xnOnDisconnect();
 	void xnOnLocoStolen(Xn::LocoAddr);
 	void xnOnTrkStatusChanged(Xn::TrkStatus);
+	void xnOnAccInputsChanged(Xn::AccInputChanges changes);
+	void metricsTick();
 
 private:
 	void xnGotLIVersion(void *, unsigned hw, unsigned sw);
@@ -77,6 +106,7 @@ private:
 	void getLIVersion();
 	void getCSVersion();
 	void getCSStatus();
+	void openError(const QString &message);
 };
 
 ///////////////////////////////////////////////////////////////////////////////
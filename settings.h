@@ -16,7 +16,19 @@ const Config DEFAULTS {
 		{"flowcontrol", 1},
 		{"loglevel", 1},
 		{"interface", "LI101"},
+		{"transport", "serial"},
+		{"host", "192.168.0.200"},
+		{"tcpPort", 5550},
 		{"outIntervalMs", 50},
+		{"pacing", "fixed"},
+		{"pacingBurstMs", 100},
+		{"pendingMax", 0},
+		{"readBufferSize", 256},
+		{"coalesce", false},
+		{"locoCache", "off"},
+		{"locoCacheMaxAgeMs", 10000},
+		{"feedbackWindowMs", 0},
+		{"engineThread", true},
 	}},
 };
 
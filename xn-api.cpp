@@ -23,26 +23,64 @@ void XpressNet::connect(const QString &portname, int32_t br, QSerialPort::FlowCo
 		}
 	}
 
-	m_serialPort.setBaudRate(br);
-	m_serialPort.setFlowControl(fc);
-	m_serialPort.setPortName(port);
+	auto serial = std::make_unique<SerialTransport>();
+	serial->configure(port, br, fc);
+	this->connect(std::move(serial), liType);
+}
+
+void XpressNet::connectTcp(const QString &host, uint16_t port) {
+	log("Connecting to " + host + ":" + QString::number(port) + " (" +
+	    liInterfaceName(LIType::LIUSBEth) + " via TCP) ...", LogLevel::Info);
+
+	auto tcp = std::make_unique<TcpTransport>();
+	tcp->configure(host, port);
+	this->connect(std::move(tcp), LIType::LIUSBEth);
+}
+
+void XpressNet::connect(std::unique_ptr<Transport> transport, LIType liType) {
+	if (this->connected() || m_connecting)
+		throw EOpenError("Already connected!");
+
+	m_transport = std::move(transport);
+	QObject::connect(m_transport.get(), SIGNAL(readyRead()), this, SLOT(handleReadyRead()));
+	QObject::connect(m_transport.get(), SIGNAL(error(QString)), this, SLOT(handleError(QString)));
+	QObject::connect(m_transport.get(), SIGNAL(aboutToClose()), this, SLOT(sp_about_to_close()));
+	QObject::connect(m_transport.get(), SIGNAL(opened()), this, SLOT(handleOpened()));
+	m_transport->setReadBufferSize(m_config.readBufferSize);
+
 	m_liType = liType;
+	m_framer.clear();
+	m_framer.setLiHeader(liType == LIType::LIUSBEth);
 
-	if (!m_serialPort.open(QIODevice::ReadWrite))
-		throw EOpenError(m_serialPort.errorString());
+	if (!m_transport->open())
+		throw EOpenError(m_transport->errorString());
+
+	m_connecting = true;
+	if (m_transport->isOpen())
+		this->handleOpened();
+	else
+		log("Waiting for connection...", LogLevel::Info);
+}
+
+void XpressNet::handleOpened() {
+	if (!m_connecting)
+		return;
+	m_connecting = false;
+	this->pacer_configure();
 
-	m_pending_timer.start(_PENDING_CHECK_INTERVAL);
 	log("Connected", LogLevel::Info);
 	emit onConnect();
 }
 
 void XpressNet::disconnect() {
 	log("Disconnecting...", LogLevel::Info);
-	m_serialPort.close();
+	m_connecting = false;
+	if (m_transport != nullptr)
+		m_transport->close();
 	emit onDisconnect();
 }
 
-bool XpressNet::connected() const { return m_serialPort.isOpen(); }
+bool XpressNet::connected() const { return (m_transport != nullptr) && m_transport->isOpen(); }
 TrkStatus XpressNet::getTrkStatus() const { return m_trk_status; }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -62,6 +100,7 @@ void XpressNet::emergencyStop(const LocoAddr addr, UPCb ok, UPCb err) {
 }
 
 void XpressNet::emergencyStop(UPCb ok, UPCb err) {
+	m_locos.forget(LocoState::Speed); // command station does not acknowledge it
 	to_send(CmdEmergencyStop(), std::move(ok), std::move(err));
 }
 
@@ -95,32 +134,188 @@ void XpressNet::pomWriteBit(const LocoAddr addr, uint16_t cv, uint8_t biti, bool
 }
 
 void XpressNet::setSpeed(const LocoAddr addr, uint8_t speed, Direction direction, UPCb ok,
-                         UPCb err) {
-	to_send(CmdSetSpeedDir(addr, speed, direction), std::move(ok), std::move(err));
+                         UPCb err, UPCb superseded) {
+	to_send(CmdSetSpeedDir(addr, speed, direction), std::move(ok), std::move(err),
+	        std::move(superseded));
 }
 
 void XpressNet::getLocoInfo(const LocoAddr addr, GotLocoInfo const &callback, UPCb err) {
+	const LocoState *cached = this->locoCached(addr, LocoState::INFO);
+	if (cached != nullptr) {
+		log(LogLevel::Commands, [&]() { return "Loco " + QString(addr) + " information cached"; });
+		if (callback != nullptr)
+			callback(this, cached->used, cached->direction, cached->speed, cached->fa, cached->fb);
+		return;
+	}
 	to_send(CmdGetLocoInfo(addr, callback), nullptr, std::move(err));
 }
 
 void XpressNet::getLocoFunc1328(LocoAddr addr, GotLocoFunc1328 callback, UPCb err) {
+	const LocoState *cached = this->locoCached(addr, LocoState::FUNC1328);
+	if (cached != nullptr) {
+		log(LogLevel::Commands, [&]() { return "Loco " + QString(addr) + " func 13-28 cached"; });
+		if (callback != nullptr)
+			callback(this, cached->fc, cached->fd);
+		return;
+	}
 	to_send(CmdGetLocoFunc1328(addr, callback), nullptr, std::move(err));
 }
 
-void XpressNet::setFuncA(const LocoAddr addr, const FA fa, UPCb ok, UPCb err) {
-	to_send(CmdSetFuncA(addr, fa), std::move(ok), std::move(err));
+struct LocoAcquisition {
+	struct Loco {
+		LocoAddr addr;
+		LocoState state;
+		unsigned remaining = 2; // information & functions 13-28
+		bool failed = false;
+
+		Loco(LocoAddr addr) : addr(addr) {}
+	};
+
+	// Queries of one kind go one after another: their replies carry no loco
+	// address, so only one of each kind could be in flight (see isLocoQuery).
+	// Information of one loco is pipelined with functions 13-28 of another.
+	struct Chain {
+		size_t next = 0; // index of the next loco to query
+		bool running = false; // inside query loop
+		bool again = false; // answered synchronously (cache, send error) -> next query
+	};
+
+	std::vector<Loco> locos;
+	size_t remaining;
+	size_t acquired = 0;
+	size_t failed = 0;
+	GotLoco onAcquired;
+	LocoNotAcquired onFailed;
+	LocosAcquired onDone;
+	Chain info;
+	Chain func;
+
+	void answered(XpressNet *xn, size_t i, bool ok) {
+		Loco &loco = locos[i];
+		if (!ok)
+			loco.failed = true;
+		if (--loco.remaining > 0)
+			return;
+
+		if (loco.failed) {
+			failed++;
+			if (onFailed != nullptr)
+				onFailed(xn, loco.addr);
+		} else {
+			acquired++;
+			if (onAcquired != nullptr)
+				onAcquired(xn, loco.addr, loco.state);
+		}
+		if ((--remaining == 0) && (onDone != nullptr))
+			onDone(xn, acquired, failed);
+	}
+
+	static void queryNext(XpressNet *xn, const std::shared_ptr<LocoAcquisition> &self, bool info);
+	static void query(XpressNet *xn, const std::shared_ptr<LocoAcquisition> &self, bool info,
+	                  size_t i);
+};
+
+void LocoAcquisition::queryNext(XpressNet *xn, const std::shared_ptr<LocoAcquisition> &self,
+                                bool info) {
+	// Loop instead of recursion: cached locos are answered inside the query
+	Chain &chain = info ? self->info : self->func;
+	if (chain.running) {
+		chain.again = true;
+		return;
+	}
+	chain.running = true;
+	do {
+		chain.again = false;
+		if (chain.next < self->locos.size())
+			query(xn, self, info, chain.next++);
+	} while (chain.again);
+	chain.running = false;
+}
+
+void LocoAcquisition::query(XpressNet *xn, const std::shared_ptr<LocoAcquisition> &self,
+                            bool info, size_t i) {
+	UPCb err = std::make_unique<Cb>([xn, self, info, i](void *, void *) {
+		self->answered(xn, i, false);
+		queryNext(xn, self, info);
+	});
+
+	try {
+		if (info) {
+			xn->getLocoInfo(
+				self->locos[i].addr,
+				[xn, self, i](void *, bool used, Direction direction, unsigned speed, FA fa, FB fb) {
+					LocoState &state = self->locos[i].state;
+					state.known |= LocoState::INFO;
+					state.used = used;
+					state.direction = direction;
+					state.speed = static_cast<uint8_t>(speed);
+					state.fa = fa;
+					state.fb = fb;
+					self->answered(xn, i, true);
+					queryNext(xn, self, true);
+				},
+				std::move(err)
+			);
+		} else {
+			xn->getLocoFunc1328(
+				self->locos[i].addr,
+				[xn, self, i](void *, FC fc, FD fd) {
+					LocoState &state = self->locos[i].state;
+					state.known |= LocoState::FUNC1328;
+					state.fc = fc;
+					state.fd = fd;
+					self->answered(xn, i, true);
+					queryNext(xn, self, false);
+				},
+				std::move(err)
+			);
+		}
+	} catch (...) {
+		self->answered(xn, i, false);
+		(info ? self->info : self->func).again = true;
+	}
+}
+
+void XpressNet::acquireLocos(const std::vector<LocoAddr> &locos, GotLoco const &acquired,
+                             LocoNotAcquired const &failed, LocosAcquired const &done) {
+	if (locos.empty()) {
+		if (done != nullptr)
+			done(this, 0, 0);
+		return;
+	}
+
+	log(LogLevel::Commands, [&]() { return "Acquiring " + QString::number(locos.size()) + " locos"; });
+	auto acquisition = std::make_shared<LocoAcquisition>();
+	acquisition->locos.reserve(locos.size());
+	for (const LocoAddr addr : locos)
+		acquisition->locos.emplace_back(addr);
+	acquisition->remaining = locos.size();
+	acquisition->onAcquired = acquired;
+	acquisition->onFailed = failed;
+	acquisition->onDone = done;
+
+	// Two queries in flight at once (information & functions 13-28), the rest
+	// of the outgoing queue is not blocked by the acquisition.
+	LocoAcquisition::queryNext(this, acquisition, true);
+	LocoAcquisition::queryNext(this, acquisition, false);
+}
+
+void XpressNet::setFuncA(const LocoAddr addr, const FA fa, UPCb ok, UPCb err,
+                         UPCb superseded) {
+	to_send(CmdSetFuncA(addr, fa), std::move(ok), std::move(err), std::move(superseded));
 }
 
-void XpressNet::setFuncB(const LocoAddr addr, const FB fb, const FSet range, UPCb ok, UPCb err) {
-	to_send(CmdSetFuncB(addr, fb, range), std::move(ok), std::move(err));
+void XpressNet::setFuncB(const LocoAddr addr, const FB fb, const FSet range, UPCb ok, UPCb err,
+                         UPCb superseded) {
+	to_send(CmdSetFuncB(addr, fb, range), std::move(ok), std::move(err), std::move(superseded));
 }
 
-void XpressNet::setFuncC(LocoAddr addr, FC fc, UPCb ok, UPCb err) {
-	to_send(CmdSetFuncC(addr, fc), std::move(ok), std::move(err));
+void XpressNet::setFuncC(LocoAddr addr, FC fc, UPCb ok, UPCb err, UPCb superseded) {
+	to_send(CmdSetFuncC(addr, fc), std::move(ok), std::move(err), std::move(superseded));
 }
 
-void XpressNet::setFuncD(LocoAddr addr, FD fd, UPCb ok, UPCb err) {
-	to_send(CmdSetFuncD(addr, fd), std::move(ok), std::move(err));
+void XpressNet::setFuncD(LocoAddr addr, FD fd, UPCb ok, UPCb err, UPCb superseded) {
+	to_send(CmdSetFuncD(addr, fd), std::move(ok), std::move(err), std::move(superseded));
 }
 
 void XpressNet::readCVdirect(uint8_t cv, ReadCV const &callback, UPCb err) {
@@ -0,0 +1,47 @@
+#ifndef XN_CLOCK_H
+#define XN_CLOCK_H
+
+/*
+This file defines time source of the XpressNet engine.
+All deadlines inside the engine are integer timestamps of a monotonic clock,
+so they are not affected by changes of wall-clock time (NTP, DST, user).
+Time source is injectable: VirtualClock allows to drive time manually.
+*/
+
+#include <chrono>
+#include <cstdint>
+
+namespace Xn {
+
+using Timestamp = int64_t; // microseconds
+
+constexpr Timestamp msToTimestamp(int64_t ms) { return ms * 1000; }
+
+class TimeSource {
+public:
+	virtual ~TimeSource() = default;
+	virtual Timestamp now() const = 0;
+};
+
+class SteadyClock : public TimeSource {
+public:
+	Timestamp now() const override {
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+		       std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+};
+
+class VirtualClock : public TimeSource {
+public:
+	explicit VirtualClock(Timestamp start = 0) : m_now(start) {}
+	Timestamp now() const override { return m_now; }
+	void set(Timestamp now) { m_now = now; }
+	void advance(Timestamp by) { m_now += by; }
+
+private:
+	Timestamp m_now;
+};
+
+} // namespace Xn
+
+#endif
@@ -7,10 +7,12 @@ Each command type has its own class inherited from XnCmd.
 See xn.h or README for more documentation.
 */
 
+#include <array>
 #include <functional>
-#include <vector>
+#include <initializer_list>
 
 #include "q-str-exception.h"
+#include "xn-frame.h"
 #include "xn-loco-addr.h"
 
 namespace Xn {
@@ -22,97 +24,315 @@ struct EInvalidSpeed : public QStrException {
 	EInvalidSpeed(const QString str) : QStrException(str) {}
 };
 
+enum class CmdType {
+	Off,
+	On,
+	EmergencyStop,
+	EmergencyStopLoco,
+	GetLIVersion,
+	GetLIAddress,
+	SetLIAddress,
+	GetCSVersion,
+	GetCSStatus,
+	PomWriteCv,
+	PomWriteBit,
+	GetLocoInfo,
+	GetLocoFunc1328,
+	SetSpeedDir,
+	SetFuncA,
+	SetFuncB,
+	SetFuncC,
+	SetFuncD,
+	ReadDirect,
+	WriteDirect,
+	RequestReadResult,
+	RequestWriteResult,
+	AccInfoRequest,
+	AccOpRequest,
+};
+
+constexpr size_t _CMD_TYPE_COUNT = static_cast<size_t>(CmdType::AccOpRequest) + 1;
+
+// Priority class of a command = lane of outgoing queue the command waits in.
+enum class CmdPriority {
+	Safety = 0, // emergency stops & track power
+	Control = 1, // loco speed & functions
+	Operation = 2, // accessories, POM, programming & LI settings
+	Query = 3, // information requests & polling
+};
+
+constexpr size_t _CMD_PRIORITY_COUNT = static_cast<size_t>(CmdPriority::Query) + 1;
+
+inline CmdPriority priority(CmdType type) {
+	switch (type) {
+	case CmdType::Off:
+	case CmdType::On:
+	case CmdType::EmergencyStop:
+	case CmdType::EmergencyStopLoco:
+		return CmdPriority::Safety;
+	case CmdType::SetSpeedDir:
+	case CmdType::SetFuncA:
+	case CmdType::SetFuncB:
+	case CmdType::SetFuncC:
+	case CmdType::SetFuncD:
+		return CmdPriority::Control;
+	case CmdType::SetLIAddress:
+	case CmdType::PomWriteCv:
+	case CmdType::PomWriteBit:
+	case CmdType::ReadDirect:
+	case CmdType::WriteDirect:
+	case CmdType::RequestReadResult:
+	case CmdType::RequestWriteResult:
+	case CmdType::AccOpRequest:
+		return CmdPriority::Operation;
+	case CmdType::GetLIVersion:
+	case CmdType::GetLIAddress:
+	case CmdType::GetCSVersion:
+	case CmdType::GetCSStatus:
+	case CmdType::GetLocoInfo:
+	case CmdType::GetLocoFunc1328:
+	case CmdType::AccInfoRequest:
+		return CmdPriority::Query;
+	}
+	return CmdPriority::Query;
+}
+
+// Direct mode programming commands, answered by service mode results.
+inline bool isProgramming(CmdType type) {
+	return (type == CmdType::ReadDirect) || (type == CmdType::WriteDirect) ||
+	       (type == CmdType::RequestReadResult) || (type == CmdType::RequestWriteResult);
+}
+
+// Loco queries answered by replies without loco address: at most one query
+// of each type is in flight (type-wide conflict key), so a reply belongs to
+// the only pending query of its type.
+inline bool isLocoQuery(CmdType type) {
+	return (type == CmdType::GetLocoInfo) || (type == CmdType::GetLocoFunc1328);
+}
+
+// Short stable identifier of command type (benchmarks, statistics)
+inline const char *cmdTypeName(CmdType type) {
+	switch (type) {
+	case CmdType::Off: return "Off";
+	case CmdType::On: return "On";
+	case CmdType::EmergencyStop: return "EmergencyStop";
+	case CmdType::EmergencyStopLoco: return "EmergencyStopLoco";
+	case CmdType::GetLIVersion: return "GetLIVersion";
+	case CmdType::GetLIAddress: return "GetLIAddress";
+	case CmdType::SetLIAddress: return "SetLIAddress";
+	case CmdType::GetCSVersion: return "GetCSVersion";
+	case CmdType::GetCSStatus: return "GetCSStatus";
+	case CmdType::PomWriteCv: return "PomWriteCv";
+	case CmdType::PomWriteBit: return "PomWriteBit";
+	case CmdType::GetLocoInfo: return "GetLocoInfo";
+	case CmdType::GetLocoFunc1328: return "GetLocoFunc1328";
+	case CmdType::SetSpeedDir: return "SetSpeedDir";
+	case CmdType::SetFuncA: return "SetFuncA";
+	case CmdType::SetFuncB: return "SetFuncB";
+	case CmdType::SetFuncC: return "SetFuncC";
+	case CmdType::SetFuncD: return "SetFuncD";
+	case CmdType::ReadDirect: return "ReadDirect";
+	case CmdType::WriteDirect: return "WriteDirect";
+	case CmdType::RequestReadResult: return "RequestReadResult";
+	case CmdType::RequestWriteResult: return "RequestWriteResult";
+	case CmdType::AccInfoRequest: return "AccInfoRequest";
+	case CmdType::AccOpRequest: return "AccOpRequest";
+	}
+	return "Unknown";
+}
+
+// Conflict keys describe resources a command works with. Each command
+// publishes keys it holds while queued (heldKeys) & keys whose presence in a
+// queue means conflict with the command (conflictKeys). conflictKeys contain
+// both directions of the relation, so checking a new command against queue
+// is a lookup of its conflictKeys in index of held keys.
+enum class ConflictKeyType : uint8_t {
+	TrackOn,
+	TrackOff,
+	EmergencyStopAll,
+	EmergencyStopLoco, // loco
+	Speed, // loco
+	SpeedAny,
+	LIAddress,
+	PomCv, // loco & cv
+	PomBitCv, // loco & cv, held by any bit write
+	PomBit, // loco & cv & bit
+	FuncA, // loco
+	FuncB, // loco & range
+	FuncC, // loco
+	FuncD, // loco
+	AccPair, // portAddr/2
+	LocoInfoQuery, // any loco: reply carries no loco address
+	LocoFuncQuery, // any loco: reply carries no loco address
+};
+
+using ConflictKey = uint64_t;
+
+constexpr ConflictKey conflictKey(ConflictKeyType type, uint64_t value = 0) {
+	return (static_cast<uint64_t>(type) << 56) | value;
+}
+
+struct ConflictKeys {
+	static constexpr size_t _MAX_KEYS = 3;
+
+	std::array<ConflictKey, _MAX_KEYS> keys {};
+	size_t count = 0;
+
+	ConflictKeys() = default;
+	ConflictKeys(std::initializer_list<ConflictKey> init) {
+		for (ConflictKey key : init)
+			keys[count++] = key;
+	}
+	const ConflictKey *begin() const { return keys.data(); }
+	const ConflictKey *end() const { return keys.data() + count; }
+	bool contains(ConflictKey key) const {
+		for (ConflictKey k : *this)
+			if (k == key)
+				return true;
+		return false;
+	}
+};
+
 struct Cmd {
-	virtual std::vector<uint8_t> getBytes() const = 0;
+	Cmd(CmdType type) : m_type(type) {}
+	virtual Frame getBytes() const = 0;
 	virtual QString msg() const = 0;
 	virtual ~Cmd() = default;
-	virtual bool conflict(const Cmd &) const { return false; }
+	virtual ConflictKeys heldKeys() const { return {}; }
+	virtual ConflictKeys conflictKeys() const { return {}; }
 	virtual bool okResponse() const { return false; }
+	CmdType type() const { return m_type; }
+
+	bool conflict(const Cmd &cmd) const {
+		const ConflictKeys held = cmd.heldKeys();
+		for (ConflictKey key : this->conflictKeys())
+			if (held.contains(key))
+				return true;
+		return false;
+	}
+
+private:
+	CmdType m_type;
+};
+
+// Each command carries its CmdType tag, so the protocol engine identifies
+// commands by comparing tags instead of using RTTI.
+template <CmdType T>
+struct CmdOfType : public Cmd {
+	static constexpr CmdType TYPE = T;
+	CmdOfType() : Cmd(T) {}
 };
 
+template <CmdType T>
+constexpr CmdType CmdOfType<T>::TYPE;
+
 template <typename Target>
 bool is(const Cmd &x) {
-	return (dynamic_cast<const Target *>(&x) != nullptr);
+	return (x.type() == Target::TYPE);
+}
+
+// Cast to specific command; caller must ensure is<Target>(x).
+template <typename Target>
+const Target &as(const Cmd &x) {
+	return static_cast<const Target &>(x); // NOLINT(cppcoreguidelines-pro-type-static-cast-downcast)
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
-struct CmdOff : public Cmd {
-	std::vector<uint8_t> getBytes() const override { return {0x21, 0x80}; }
+struct CmdOff : public CmdOfType<CmdType::Off> {
+	Frame getBytes() const override { return {0x21, 0x80}; }
 	QString msg() const override { return "Track Off"; }
+	ConflictKeys heldKeys() const override { return {conflictKey(ConflictKeyType::TrackOff)}; }
+	ConflictKeys conflictKeys() const override {
+		return {conflictKey(ConflictKeyType::TrackOn)};
+	}
 };
 
-struct CmdOn : public Cmd {
-	std::vector<uint8_t> getBytes() const override { return {0x21, 0x81}; }
+struct CmdOn : public CmdOfType<CmdType::On> {
+	Frame getBytes() const override { return {0x21, 0x81}; }
 	QString msg() const override { return "Track On"; }
-	bool conflict(const Cmd &cmd) const override { return is<CmdOff>(cmd); }
+	ConflictKeys heldKeys() const override { return {conflictKey(ConflictKeyType::TrackOn)}; }
+	ConflictKeys conflictKeys() const override {
+		return {conflictKey(ConflictKeyType::TrackOff)};
+	}
 };
 
-struct CmdEmergencyStop : public Cmd {
-	std::vector<uint8_t> getBytes() const override { return {0x80}; }
+struct CmdEmergencyStop : public CmdOfType<CmdType::EmergencyStop> {
+	Frame getBytes() const override { return {0x80}; }
 	QString msg() const override { return "All Loco Emergency Stop"; }
+	ConflictKeys heldKeys() const override {
+		return {conflictKey(ConflictKeyType::EmergencyStopAll)};
+	}
+	ConflictKeys conflictKeys() const override { return {conflictKey(ConflictKeyType::SpeedAny)}; }
 };
 
-struct CmdEmergencyStopLoco : public Cmd {
+struct CmdEmergencyStopLoco : public CmdOfType<CmdType::EmergencyStopLoco> {
 	const LocoAddr loco;
 
 	CmdEmergencyStopLoco(const LocoAddr loco) : loco(loco) {}
-	std::vector<uint8_t> getBytes() const override { return {0x92, loco.hi(), loco.lo()}; }
+	Frame getBytes() const override { return {0x92, loco.hi(), loco.lo()}; }
 	QString msg() const override { return "Single Loco Emergency Stop : " + QString::number(loco); }
 	bool okResponse() const override { return true; }
+	ConflictKeys heldKeys() const override {
+		return {conflictKey(ConflictKeyType::EmergencyStopLoco, loco)};
+	}
+	ConflictKeys conflictKeys() const override {
+		return {conflictKey(ConflictKeyType::Speed, loco)};
+	}
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 
 using GotLIVersion = std::function<void(void *sender, unsigned hw, unsigned sw)>;
 
-struct CmdGetLIVersion : public Cmd {
+struct CmdGetLIVersion : public CmdOfType<CmdType::GetLIVersion> {
 	GotLIVersion const callback;
 
 	CmdGetLIVersion(GotLIVersion const callback) : callback(callback) {}
-	std::vector<uint8_t> getBytes() const override { return {0xF0}; }
+	Frame getBytes() const override { return {0xF0}; }
 	QString msg() const override { return "LI Get Version"; }
 };
 
 using GotLIAddress = std::function<void(void *sender, unsigned addr)>;
 
-struct CmdGetLIAddress : public Cmd {
+struct CmdGetLIAddress : public CmdOfType<CmdType::GetLIAddress> {
 	GotLIAddress const callback;
 
 	CmdGetLIAddress(GotLIAddress const callback) : callback(callback) {}
-	std::vector<uint8_t> getBytes() const override { return {0xF2, 0x01, 0x00}; }
+	Frame getBytes() const override { return {0xF2, 0x01, 0x00}; }
 	QString msg() const override { return "LI Get Address"; }
 };
 
-struct CmdSetLIAddress : public Cmd {
+struct CmdSetLIAddress : public CmdOfType<CmdType::SetLIAddress> {
 	const unsigned addr;
 
 	CmdSetLIAddress(const unsigned addr) : addr(addr) {}
-	std::vector<uint8_t> getBytes() const override {
+	Frame getBytes() const override {
 		return {0xF2, 0x01, static_cast<uint8_t>(addr)};
 	}
 	QString msg() const override { return "LI Set Address to " + QString::number(addr); }
-	bool conflict(const Cmd &cmd) const override { return is<CmdSetLIAddress>(cmd); }
+	ConflictKeys heldKeys() const override { return {conflictKey(ConflictKeyType::LIAddress)}; }
+	ConflictKeys conflictKeys() const override { return heldKeys(); }
 };
 
 using GotCSVersion = std::function<void(void *sender, unsigned major, unsigned minor, uint8_t id)>;
 
-struct CmdGetCSVersion : public Cmd {
+struct CmdGetCSVersion : public CmdOfType<CmdType::GetCSVersion> {
 	GotCSVersion const callback;
 
 	CmdGetCSVersion(GotCSVersion const callback) : callback(callback) {}
-	std::vector<uint8_t> getBytes() const override { return {0x21, 0x21}; }
+	Frame getBytes() const override { return {0x21, 0x21}; }
 	QString msg() const override { return "Get Command station version"; }
 };
 
-struct CmdGetCSStatus : public Cmd {
-	std::vector<uint8_t> getBytes() const override { return {0x21, 0x24}; }
+struct CmdGetCSStatus : public CmdOfType<CmdType::GetCSStatus> {
+	Frame getBytes() const override { return {0x21, 0x24}; }
 	QString msg() const override { return "Get Command station status"; }
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 
-struct CmdPomWriteCv : public Cmd {
+struct CmdPomWriteCv : public CmdOfType<CmdType::PomWriteCv> {
 	const LocoAddr loco;
 	const uint16_t cv;
 	const uint8_t value;
@@ -122,7 +342,7 @@ struct CmdPomWriteCv : public Cmd {
 		if (cv > 1023)
 			throw EInvalidCv("CV value is too high!");
 	}
-	std::vector<uint8_t> getBytes() const override {
+	Frame getBytes() const override {
 		return {
 			0xE6, 0x30, loco.hi(), loco.lo(),
 			static_cast<uint8_t>(0xEC + (((cv-1) >> 8) & 0x03)),
@@ -133,17 +353,17 @@ struct CmdPomWriteCv : public Cmd {
 		return "POM Addr " + QString::number(loco.addr) + ", CV " + QString::number(cv) +
 		       ", Value: " + QString::number(value);
 	}
-	bool conflict(const Cmd &cmd) const override {
-		if (is<CmdPomWriteCv>(cmd)) {
-			const auto &casted = dynamic_cast<const CmdPomWriteCv &>(cmd);
-			return ((casted.loco == this->loco) && (casted.cv == this->cv));
-		}
-		return false;
+	ConflictKeys heldKeys() const override {
+		return {conflictKey(ConflictKeyType::PomCv, (loco.addr << 16) | cv)};
+	}
+	ConflictKeys conflictKeys() const override {
+		return {conflictKey(ConflictKeyType::PomCv, (loco.addr << 16) | cv),
+		        conflictKey(ConflictKeyType::PomBitCv, (loco.addr << 16) | cv)};
 	}
 	bool okResponse() const override { return true; }
 };
 
-struct CmdPomWriteBit : public Cmd {
+struct CmdPomWriteBit : public CmdOfType<CmdType::PomWriteBit> {
 	const LocoAddr loco;
 	const uint16_t cv;
 	const uint8_t biti;
@@ -154,7 +374,7 @@ struct CmdPomWriteBit : public Cmd {
 		if (cv > 1023)
 			throw EInvalidCv("CV value is too high!");
 	}
-	std::vector<uint8_t> getBytes() const override {
+	Frame getBytes() const override {
 		return {0xE6, 0x30, loco.hi(), loco.lo(),
 		        static_cast<uint8_t>(0xE8 + (((cv-1) >> 8) & 0x03)),
 		        static_cast<uint8_t>((cv-1) & 0xFF),
@@ -164,17 +384,13 @@ struct CmdPomWriteBit : public Cmd {
 		return "POM Addr " + QString::number(loco.addr) + ", CV " + QString::number(cv) +
 		       ", Bit: " + QString::number(biti) + ", Value: " + QString::number(value);
 	}
-	bool conflict(const Cmd &cmd) const override {
-		if (is<CmdPomWriteBit>(cmd)) {
-			const auto &casted = dynamic_cast<const CmdPomWriteBit &>(cmd);
-			return ((casted.loco == this->loco) && (casted.cv == this->cv) &&
-			        (casted.biti == this->biti));
-		}
-		if (is<CmdPomWriteCv>(cmd)) {
-			const auto &casted = dynamic_cast<const CmdPomWriteCv &>(cmd);
-			return ((casted.loco == this->loco) && (casted.cv == this->cv));
-		}
-		return false;
+	ConflictKeys heldKeys() const override {
+		return {conflictKey(ConflictKeyType::PomBit, (loco.addr << 16) | (cv << 3) | biti),
+		        conflictKey(ConflictKeyType::PomBitCv, (loco.addr << 16) | cv)};
+	}
+	ConflictKeys conflictKeys() const override {
+		return {conflictKey(ConflictKeyType::PomBit, (loco.addr << 16) | (cv << 3) | biti),
+		        conflictKey(ConflictKeyType::PomCv, (loco.addr << 16) | cv)};
 	}
 	bool okResponse() const override { return true; }
 };
@@ -255,32 +471,36 @@ enum class Direction {
 using GotLocoInfo = std::function<void(void *sender, bool used, Direction direction,
                                          unsigned speed, FA fa, FB fb)>;
 
-struct CmdGetLocoInfo : public Cmd {
+struct CmdGetLocoInfo : public CmdOfType<CmdType::GetLocoInfo> {
 	const LocoAddr loco;
 	GotLocoInfo const callback;
 
 	CmdGetLocoInfo(const LocoAddr loco, GotLocoInfo const callback)
 	    : loco(loco), callback(callback) {}
-	std::vector<uint8_t> getBytes() const override { return {0xE3, 0x00, loco.hi(), loco.lo()}; }
+	Frame getBytes() const override { return {0xE3, 0x00, loco.hi(), loco.lo()}; }
 	QString msg() const override { return "Get Loco Information " + QString::number(loco.addr); }
+	ConflictKeys heldKeys() const override { return {conflictKey(ConflictKeyType::LocoInfoQuery)}; }
+	ConflictKeys conflictKeys() const override { return heldKeys(); }
 };
 
 using GotLocoFunc1328 = std::function<void(void *sender, FC fc, FD fd)>;
 
-struct CmdGetLocoFunc1328 : public Cmd {
+struct CmdGetLocoFunc1328 : public CmdOfType<CmdType::GetLocoFunc1328> {
 	const LocoAddr loco;
 	GotLocoFunc1328 const callback;
 
 	CmdGetLocoFunc1328(const LocoAddr loco, GotLocoFunc1328 const callback)
 	    : loco(loco), callback(callback) {}
-	std::vector<uint8_t> getBytes() const override { return {0xE3, 0x09, loco.hi(), loco.lo()}; }
+	Frame getBytes() const override { return {0xE3, 0x09, loco.hi(), loco.lo()}; }
 	QString msg() const override {
 		return "Get Loco Function 13-28 Status " + QString::number(loco.addr);
 	}
+	ConflictKeys heldKeys() const override { return {conflictKey(ConflictKeyType::LocoFuncQuery)}; }
+	ConflictKeys conflictKeys() const override { return heldKeys(); }
 };
 ///////////////////////////////////////////////////////////////////////////////
 
-struct CmdSetSpeedDir : public Cmd {
+struct CmdSetSpeedDir : public CmdOfType<CmdType::SetSpeedDir> {
 	const LocoAddr loco;
 	const unsigned speed;
 	const Direction dir;
@@ -291,7 +511,7 @@ struct CmdSetSpeedDir : public Cmd {
 			throw EInvalidSpeed("Speed out of range!");
 	}
 
-	std::vector<uint8_t> getBytes() const override {
+	Frame getBytes() const override {
 		unsigned sp;
 		if (speed > 0)
 			sp = speed + 3;
@@ -305,42 +525,32 @@ struct CmdSetSpeedDir : public Cmd {
 		return "Loco " + QString::number(loco) + " Set Speed " + QString::number(speed) +
 		       ", Dir " + QString::number(static_cast<int>(dir));
 	}
-	bool conflict(const Cmd &cmd) const override {
-		if (is<CmdSetSpeedDir>(cmd)) {
-			const auto &casted = dynamic_cast<const CmdSetSpeedDir &>(cmd);
-			return (casted.loco == this->loco);
-		}
-		if (is<CmdEmergencyStop>(cmd))
-			return true;
-		if (is<CmdEmergencyStopLoco>(cmd)) {
-			const auto &casted = dynamic_cast<const CmdEmergencyStopLoco &>(cmd);
-			return (casted.loco == this->loco);
-		}
-		return false;
+	ConflictKeys heldKeys() const override {
+		return {conflictKey(ConflictKeyType::Speed, loco), conflictKey(ConflictKeyType::SpeedAny)};
+	}
+	ConflictKeys conflictKeys() const override {
+		return {conflictKey(ConflictKeyType::Speed, loco),
+		        conflictKey(ConflictKeyType::EmergencyStopAll),
+		        conflictKey(ConflictKeyType::EmergencyStopLoco, loco)};
 	}
 	bool okResponse() const override { return true; }
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 
-struct CmdSetFuncA : public Cmd {
+struct CmdSetFuncA : public CmdOfType<CmdType::SetFuncA> {
 	const LocoAddr loco;
 	const FA fa;
 
 	CmdSetFuncA(const LocoAddr loco, const FA fa) : loco(loco), fa(fa) {}
-	std::vector<uint8_t> getBytes() const override {
+	Frame getBytes() const override {
 		return {0xE4, 0x20, loco.hi(), loco.lo(), fa.all};
 	}
 	QString msg() const override {
 		return "Set loco " + QString::number(loco.addr) + " func A (0-4): " + QString::number(fa.all, 2).rightJustified(5, '0');
 	}
-	bool conflict(const Cmd &cmd) const override {
-		if (is<CmdSetFuncA>(cmd)) {
-			const auto &casted = dynamic_cast<const CmdSetFuncA &>(cmd);
-			return (casted.loco == this->loco);
-		}
-		return false;
-	}
+	ConflictKeys heldKeys() const override { return {conflictKey(ConflictKeyType::FuncA, loco)}; }
+	ConflictKeys conflictKeys() const override { return heldKeys(); }
 	bool okResponse() const override { return true; }
 };
 
@@ -349,14 +559,14 @@ enum class FSet {
 	F9toF12,
 };
 
-struct CmdSetFuncB : public Cmd {
+struct CmdSetFuncB : public CmdOfType<CmdType::SetFuncB> {
 	const LocoAddr loco;
 	const FB fb;
 	const FSet range;
 
 	CmdSetFuncB(const LocoAddr loco, const FB fb, const FSet range)
 	    : loco(loco), fb(fb), range(range) {}
-	std::vector<uint8_t> getBytes() const override {
+	Frame getBytes() const override {
 		if (range == FSet::F5toF8)
 			return {0xE4, 0x21, loco.hi(), loco.lo(), static_cast<uint8_t>(fb.all & 0xF)};
 		return {0xE4, 0x22, loco.hi(), loco.lo(), static_cast<uint8_t>(fb.all >> 4)};
@@ -364,55 +574,42 @@ struct CmdSetFuncB : public Cmd {
 	QString msg() const override {
 		return "Set loco " + QString::number(loco.addr) + " func B (5-12): " + QString::number(fb.all, 2).rightJustified(8, '0');
 	}
-	bool conflict(const Cmd &cmd) const override {
-		if (is<CmdSetFuncB>(cmd)) {
-			const auto &casted = dynamic_cast<const CmdSetFuncB &>(cmd);
-			return ((casted.loco == this->loco) && (casted.range == this->range));
-		}
-		return false;
+	ConflictKeys heldKeys() const override {
+		return {conflictKey(ConflictKeyType::FuncB, (loco.addr << 1) | static_cast<unsigned>(range))};
 	}
+	ConflictKeys conflictKeys() const override { return heldKeys(); }
 	bool okResponse() const override { return true; }
 };
 
-struct CmdSetFuncC : public Cmd {
+struct CmdSetFuncC : public CmdOfType<CmdType::SetFuncC> {
 	const LocoAddr loco;
 	const FC fc;
 
 	CmdSetFuncC(const LocoAddr loco, const FC fc) : loco(loco), fc(fc) {}
-	std::vector<uint8_t> getBytes() const override {
+	Frame getBytes() const override {
 		return {0xE4, 0x23, loco.hi(), loco.lo(), fc.all};
 	}
 	QString msg() const override {
 		return "Set loco " + QString::number(loco.addr) + " func C (13-20): " + QString::number(fc.all, 2).rightJustified(8, '0');
 	}
-	bool conflict(const Cmd &cmd) const override {
-		if (is<CmdSetFuncC>(cmd)) {
-			const auto &casted = dynamic_cast<const CmdSetFuncC &>(cmd);
-			return (casted.loco == this->loco);
-		}
-		return false;
-	}
+	ConflictKeys heldKeys() const override { return {conflictKey(ConflictKeyType::FuncC, loco)}; }
+	ConflictKeys conflictKeys() const override { return heldKeys(); }
 	bool okResponse() const override { return true; }
 };
 
-struct CmdSetFuncD : public Cmd {
+struct CmdSetFuncD : public CmdOfType<CmdType::SetFuncD> {
 	const LocoAddr loco;
 	const FD fd;
 
 	CmdSetFuncD(const LocoAddr loco, const FD fd) : loco(loco), fd(fd) {}
-	std::vector<uint8_t> getBytes() const override {
+	Frame getBytes() const override {
 		return {0xE4, 0x28, loco.hi(), loco.lo(), fd.all};
 	}
 	QString msg() const override {
 		return "Set loco " + QString::number(loco.addr) + " func D (21-28): " + QString::number(fd.all, 2).rightJustified(8, '0');
 	}
-	bool conflict(const Cmd &cmd) const override {
-		if (is<CmdSetFuncD>(cmd)) {
-			const auto &casted = dynamic_cast<const CmdSetFuncD &>(cmd);
-			return (casted.loco == this->loco);
-		}
-		return false;
-	}
+	ConflictKeys heldKeys() const override { return {conflictKey(ConflictKeyType::FuncD, loco)}; }
+	ConflictKeys conflictKeys() const override { return heldKeys(); }
 	bool okResponse() const override { return true; }
 };
 
@@ -429,64 +626,64 @@ enum class ReadCVStatus {
 using ReadCV =
     std::function<void(void *sender, ReadCVStatus status, uint8_t cv, uint8_t value)>;
 
-struct CmdReadDirect : public Cmd {
+struct CmdReadDirect : public CmdOfType<CmdType::ReadDirect> {
 	const uint8_t cv;
 	ReadCV const callback;
 
 	CmdReadDirect(const uint8_t cv, ReadCV const callback) : cv(cv), callback(callback) {}
 
-	std::vector<uint8_t> getBytes() const override { return {0x22, 0x15, cv}; }
+	Frame getBytes() const override { return {0x22, 0x15, cv}; }
 	QString msg() const override {
 		return "Direct Mode CV " + QString::number(cv) + " read request";
 	}
 	bool okResponse() const override { return true; }
 };
 
-struct CmdWriteDirect : public Cmd {
+struct CmdWriteDirect : public CmdOfType<CmdType::WriteDirect> {
 	const uint8_t cv;
 	const uint8_t data;
 
 	CmdWriteDirect(const uint8_t cv, const uint8_t data)
 	    : cv(cv), data(data) {}
 
-	std::vector<uint8_t> getBytes() const override { return {0x23, 0x16, cv, data}; }
+	Frame getBytes() const override { return {0x23, 0x16, cv, data}; }
 	QString msg() const override {
 		return "Direct Mode Write CV " + QString::number(cv) + " = " + QString::number(data);
 	}
 	bool okResponse() const override { return true; }
 };
 
-struct CmdRequestReadResult : public Cmd {
+struct CmdRequestReadResult : public CmdOfType<CmdType::RequestReadResult> {
 	const uint8_t cv;
 	ReadCV const callback;
 
 	CmdRequestReadResult(const uint8_t cv, ReadCV const callback)
 	    : cv(cv), callback(callback) {}
 
-	std::vector<uint8_t> getBytes() const override { return {0x21, 0x10}; }
+	Frame getBytes() const override { return {0x21, 0x10}; }
 	QString msg() const override { return "Request for service mode results (after read)"; }
 };
 
-struct CmdRequestWriteResult : public Cmd {
+struct CmdRequestWriteResult : public CmdOfType<CmdType::RequestWriteResult> {
 	const uint8_t cv;
 	const uint8_t value;
 
 	CmdRequestWriteResult(const uint8_t cv, const uint8_t value)
 	    : cv(cv), value(value) {}
 
-	std::vector<uint8_t> getBytes() const override { return {0x21, 0x10}; }
+	Frame getBytes() const override { return {0x21, 0x10}; }
 	QString msg() const override { return "Request for service mode results (after write)"; }
 };
 
 ///////////////////////////////////////////////////////////////////////////////
 
-struct CmdAccInfoRequest : public Cmd {
+struct CmdAccInfoRequest : public CmdOfType<CmdType::AccInfoRequest> {
 	const uint8_t groupAddr;
 	const bool nibble;
 
 	CmdAccInfoRequest(const uint8_t groupAddr, const bool nibble)
 	    : groupAddr(groupAddr), nibble(nibble) {}
-	std::vector<uint8_t> getBytes() const override {
+	Frame getBytes() const override {
 		return {0x42, groupAddr, static_cast<uint8_t>(0x80+nibble) };
 	}
 	QString msg() const override {
@@ -495,13 +692,13 @@ struct CmdAccInfoRequest : public Cmd {
 	}
 };
 
-struct CmdAccOpRequest : public Cmd {
+struct CmdAccOpRequest : public CmdOfType<CmdType::AccOpRequest> {
 	const uint16_t portAddr; // 0-2047
 	const bool state;
 
 	CmdAccOpRequest(const uint16_t portAddr, const bool state)
 	    : portAddr(portAddr), state(state) {}
-	std::vector<uint8_t> getBytes() const override {
+	Frame getBytes() const override {
 		return {
 			0x52,
 			static_cast<uint8_t>(portAddr >> 3),
@@ -511,13 +708,10 @@ struct CmdAccOpRequest : public Cmd {
 		return "Accessory Decoder Operation Request: port " + QString::number(portAddr) +
 		       ", state:" + QString::number(state);
 	}
-	bool conflict(const Cmd &cmd) const override {
-		if (is<CmdAccOpRequest>(cmd)) {
-			const auto &casted = dynamic_cast<const CmdAccOpRequest &>(cmd);
-			return ((casted.portAddr/2) == (this->portAddr/2));
-		}
-		return false;
+	ConflictKeys heldKeys() const override {
+		return {conflictKey(ConflictKeyType::AccPair, portAddr/2)};
 	}
+	ConflictKeys conflictKeys() const override { return heldKeys(); }
 	bool okResponse() const override { return true; } // just for uLI
 };
 
@@ -0,0 +1,259 @@
+#include <QMetaMethod>
+#include <chrono>
+#include <thread>
+
+#include "xn-engine-thread.h"
+
+/* XpressNet engine running on its own thread. */
+
+namespace Xn {
+
+EngineThread::EngineThread(XpressNet &xn, QObject *parent) : QObject(parent), m_xn(xn) {
+	m_thread.setObjectName("xn-engine");
+
+	// Relays are called directly on the engine thread & pass events to the host
+	QObject::connect(&m_xn, SIGNAL(onError(QString)), this, SLOT(xnOnError(QString)),
+	                 Qt::DirectConnection);
+	QObject::connect(&m_xn, SIGNAL(onLog(QString, Xn::LogLevel)), this,
+	                 SLOT(xnOnLog(QString, Xn::LogLevel)), Qt::DirectConnection);
+	QObject::connect(&m_xn, SIGNAL(onConnect()), this, SLOT(xnOnConnect()), Qt::DirectConnection);
+	QObject::connect(&m_xn, SIGNAL(onConnectError(QString)), this, SLOT(xnOnConnectError(QString)),
+	                 Qt::DirectConnection);
+	QObject::connect(&m_xn, SIGNAL(onDisconnect()), this, SLOT(xnOnDisconnect()),
+	                 Qt::DirectConnection);
+	QObject::connect(&m_xn, SIGNAL(onTrkStatusChanged(Xn::TrkStatus)), this,
+	                 SLOT(xnOnTrkStatusChanged(Xn::TrkStatus)), Qt::DirectConnection);
+	QObject::connect(&m_xn, SIGNAL(onLocoStolen(Xn::LocoAddr)), this,
+	                 SLOT(xnOnLocoStolen(Xn::LocoAddr)), Qt::DirectConnection);
+	QObject::connect(&m_xn,
+	                 SIGNAL(onAccInputChanged(uint8_t, bool, bool, Xn::FeedbackType, Xn::AccInputsState)),
+	                 this,
+	                 SLOT(xnOnAccInputChanged(uint8_t, bool, bool, Xn::FeedbackType, Xn::AccInputsState)),
+	                 Qt::DirectConnection);
+	QObject::connect(&m_xn, SIGNAL(onAccInputsChanged(Xn::AccInputChanges)), this,
+	                 SLOT(xnOnAccInputsChanged(Xn::AccInputChanges)), Qt::DirectConnection);
+}
+
+EngineThread::~EngineThread() {
+	try {
+		this->stop();
+	} catch (...) {
+		// No exceptions in destructor
+	}
+}
+
+void EngineThread::start() {
+	if (this->running())
+		return;
+	if (m_xn.connected())
+		throw EEngineThread("Cannot move connected XpressNet to engine thread!");
+
+	this->refresh();
+	m_xn.moveToThread(&m_thread);
+	m_running.store(true, std::memory_order_release);
+	m_thread.start();
+}
+
+void EngineThread::stop() {
+	if (!this->running())
+		return;
+
+	QThread *host = this->thread();
+	this->post([host](XpressNet &xn) {
+		if (xn.connected())
+			xn.disconnect();
+		xn.moveToThread(host);
+		QThread::currentThread()->quit();
+	});
+	// Engine could wait for space in the host queue
+	m_hostInCall = true;
+	while (!m_thread.wait(_ENGINE_STOP_POLL))
+		this->drainHost();
+	m_hostInCall = false;
+	m_running.store(false, std::memory_order_release);
+
+	// Tasks posted after the stop task: execute on the host thread
+	Task task;
+	while (m_tasks.pop(task))
+		this->execute(task);
+	m_tasksWake.store(false);
+	this->drainHost();
+}
+
+void EngineThread::post(Task task) {
+	if (!this->running()) {
+		this->execute(task);
+		return;
+	}
+
+	m_tasks.push(std::move(task));
+	if (!m_tasksWake.exchange(true))
+		QMetaObject::invokeMethod(&m_xn, [this]() { this->drainTasks(); }, Qt::QueuedConnection);
+}
+
+void EngineThread::call(Task task) {
+	if (!this->running()) {
+		this->execute(task);
+		return;
+	}
+
+	// Events & callbacks delivered while waiting must not wait for the engine again
+	if (this->nestedCall())
+		throw EEngineThread("Nested call from an event or callback!");
+	const bool host = (QThread::currentThread() == this->thread());
+
+	std::promise<void> done;
+	std::future<void> future = done.get_future();
+	this->post([&task, &done](XpressNet &xn) {
+		try {
+			task(xn);
+		} catch (...) {
+			// Same as 'post'
+		}
+		done.set_value();
+	});
+
+	if (host)
+		m_hostInCall = true;
+	while (future.wait_for(std::chrono::milliseconds(_ENGINE_STOP_POLL)) != std::future_status::ready)
+		if (host)
+			this->drainHost(); // engine could wait for space in the host queue
+	if (host) {
+		this->drainHost();
+		m_hostInCall = false;
+	}
+}
+
+bool EngineThread::nestedCall() const {
+	return (QThread::currentThread() == this->thread()) && m_hostInCall;
+}
+
+void EngineThread::drainTasks() {
+	m_tasksWake.store(false);
+	Task task;
+	while (m_tasks.pop(task)) {
+		this->execute(task);
+		this->refresh();
+		if (m_xn.thread() != &m_thread)
+			return; // stop task executed
+	}
+}
+
+void EngineThread::execute(Task &task) {
+	try {
+		task(m_xn);
+	} catch (...) {
+		// Tasks report errors by callbacks, nothing to do here
+	}
+}
+
+void EngineThread::toHost(HostTask task) {
+	if (!this->running()) {
+		task();
+		return;
+	}
+
+	while (!m_host.push(task)) {
+		m_hostStalls.fetch_add(1, std::memory_order_relaxed);
+		std::this_thread::sleep_for(std::chrono::microseconds(_HOST_QUEUE_FULL_WAIT));
+	}
+	if (!m_hostWake.exchange(true))
+		QMetaObject::invokeMethod(this, [this]() { this->drainHost(); }, Qt::QueuedConnection);
+}
+
+void EngineThread::runOnHost(HostTask task) {
+	if ((!this->running()) || (QThread::currentThread() == this->thread())) {
+		task();
+	} else if (QThread::currentThread() == &m_thread) {
+		this->toHost(std::move(task));
+	} else {
+		// Host queue has a single producer: the engine thread
+		this->post([this, task](XpressNet &) { this->toHost(task); });
+	}
+}
+
+void EngineThread::drainHost() {
+	m_hostWake.store(false);
+	HostTask task;
+	while (m_host.pop(task))
+		task();
+}
+
+UPCb EngineThread::onHost(UPCb callback) {
+	if (callback == nullptr)
+		return nullptr;
+	std::shared_ptr<Cb> shared(std::move(callback));
+	return std::make_unique<Cb>([this, shared](void *sender, void *) {
+		this->toHost([shared, sender]() { shared->func(sender, shared->data); });
+	});
+}
+
+void EngineThread::refresh() {
+	m_connected.store(m_xn.connected(), std::memory_order_release);
+	m_trkStatus.store(static_cast<int>(m_xn.getTrkStatus()), std::memory_order_release);
+}
+
+bool EngineThread::connected() const {
+	if (!this->running())
+		return m_xn.connected();
+	return m_connected.load(std::memory_order_acquire);
+}
+
+TrkStatus EngineThread::trkStatus() const {
+	if (!this->running())
+		return m_xn.getTrkStatus();
+	return static_cast<TrkStatus>(m_trkStatus.load(std::memory_order_acquire));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Relays of XpressNet signals (engine thread)
+
+void EngineThread::xnOnError(QString error) {
+	this->refresh();
+	this->toHost([this, error]() { emit onError(error); });
+}
+
+void EngineThread::xnOnLog(QString message, LogLevel loglevel) {
+	this->toHost([this, message, loglevel]() { emit onLog(message, loglevel); });
+}
+
+void EngineThread::xnOnConnect() {
+	this->refresh();
+	this->toHost([this]() { emit onConnect(); });
+}
+
+void EngineThread::xnOnConnectError(QString error) {
+	this->refresh();
+	this->toHost([this, error]() { emit onConnectError(error); });
+}
+
+void EngineThread::xnOnDisconnect() {
+	this->refresh();
+	this->toHost([this]() { emit onDisconnect(); });
+}
+
+void EngineThread::xnOnTrkStatusChanged(TrkStatus status) {
+	this->refresh();
+	this->toHost([this, status]() { emit onTrkStatusChanged(status); });
+}
+
+void EngineThread::xnOnLocoStolen(LocoAddr addr) {
+	this->toHost([this, addr]() { emit onLocoStolen(addr); });
+}
+
+void EngineThread::xnOnAccInputChanged(uint8_t groupAddr, bool nibble, bool error,
+                                       FeedbackType inputType, AccInputsState state) {
+	// Host listening to batches only (onAccInputsChanged) does not pay for each nibble
+	if (!this->isSignalConnected(QMetaMethod::fromSignal(&EngineThread::onAccInputChanged)))
+		return;
+	this->toHost([this, groupAddr, nibble, error, inputType, state]() {
+		emit onAccInputChanged(groupAddr, nibble, error, inputType, state);
+	});
+}
+
+void EngineThread::xnOnAccInputsChanged(AccInputChanges changes) {
+	// Single crossing to the host per batch
+	this->toHost([this, changes]() { emit onAccInputsChanged(changes); });
+}
+
+} // namespace Xn
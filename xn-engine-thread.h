@@ -0,0 +1,144 @@
+#ifndef XN_ENGINE_THREAD_H
+#define XN_ENGINE_THREAD_H
+
+/*
+This file defines EngineThread, which runs XpressNet on its own worker thread
+with its own event loop, so frame parsing & pacing are not stalled by a slow
+host (GUI repaint, long callback).
+
+Threads:
+ * engine thread: owns XpressNet (its timers & transport). All calls of
+   XpressNet methods must be done here: 'post' a task from the host thread.
+   Tasks travel through a lock-free MPSC queue and are executed in the order
+   they were posted.
+ * host thread: thread EngineThread object was created in. XpressNet signals
+   are re-emitted by EngineThread here & callbacks wrapped by 'onHost' are
+   called here. Events & callbacks travel through a single bounded FIFO, so
+   the host sees them in the same order as when XpressNet runs on the host
+   thread. When the FIFO is full, the engine waits for the host.
+
+When the engine thread is not running (default), 'post' calls the task
+& 'toHost' calls the closure immediately, so behavior is the same as with
+XpressNet used directly.
+
+'start' & 'stop' must be called from the host thread. 'start' requires
+XpressNet disconnected, 'stop' disconnects it.
+
+While 'call' or 'stop' called from the host thread waits for the engine,
+events & callbacks are delivered (the engine could wait for space in the host
+FIFO), so they run inside 'call' or 'stop'. Calling 'call' from them throws
+EEngineThread: the outer call is not finished yet.
+*/
+
+#include <QObject>
+#include <QThread>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+
+#include "xn-lockfree.h"
+#include "xn.h"
+
+namespace Xn {
+
+constexpr size_t _HOST_QUEUE_SIZE = 4096; // events & callbacks waiting for the host thread
+constexpr unsigned _HOST_QUEUE_FULL_WAIT = 100; // us
+constexpr unsigned long _ENGINE_STOP_POLL = 10; // ms
+
+struct EEngineThread : public QStrException {
+	EEngineThread(const QString str) : QStrException(str) {}
+};
+
+class EngineThread : public QObject {
+	Q_OBJECT
+
+public:
+	using Task = std::function<void(XpressNet &)>;
+	using HostTask = std::function<void()>;
+
+	explicit EngineThread(XpressNet &xn, QObject *parent = nullptr);
+	~EngineThread() override;
+
+	void start();
+	void stop();
+	bool running() const { return m_running.load(std::memory_order_acquire); }
+
+	// Any thread: executes 'task' with XpressNet on the engine thread.
+	// Exceptions thrown by the task are swallowed: report errors by callbacks.
+	void post(Task task);
+	// Any thread except engine: as 'post', returns when 'task' is done. When
+	// called from the host thread, events & callbacks are delivered meanwhile,
+	// i.e. they run inside 'call'; 'call' from them throws EEngineThread.
+	void call(Task task);
+	bool nestedCall() const; // 'call' would throw (called from the host inside 'call')
+	void toHost(HostTask task); // engine thread: executes 'task' on the host thread
+	// Any thread: executes 'task' on the host thread, immediately when called
+	// from it, after events already passed to the host otherwise.
+	void runOnHost(HostTask task);
+
+	// Wrap callbacks passed to XpressNet, so they are called on the host thread
+	UPCb onHost(UPCb callback);
+	template <typename... Args>
+	std::function<void(void *, Args...)> onHost(std::function<void(void *, Args...)> callback);
+
+	// Any thread: state of XpressNet as of the last executed task or event
+	bool connected() const;
+	TrkStatus trkStatus() const;
+	size_t hostQueueStalls() const { return m_hostStalls.load(std::memory_order_relaxed); }
+
+signals:
+	void onError(QString error);
+	void onLog(QString message, Xn::LogLevel loglevel);
+	void onConnect();
+	void onConnectError(QString error);
+	void onDisconnect();
+	void onTrkStatusChanged(Xn::TrkStatus);
+	void onLocoStolen(Xn::LocoAddr);
+	void onAccInputChanged(uint8_t groupAddr, bool nibble, bool error, Xn::FeedbackType inputType,
+	                       Xn::AccInputsState state);
+	void onAccInputsChanged(Xn::AccInputChanges changes);
+
+private slots:
+	void xnOnError(QString error);
+	void xnOnLog(QString message, Xn::LogLevel loglevel);
+	void xnOnConnect();
+	void xnOnConnectError(QString error);
+	void xnOnDisconnect();
+	void xnOnTrkStatusChanged(Xn::TrkStatus);
+	void xnOnLocoStolen(Xn::LocoAddr);
+	void xnOnAccInputChanged(uint8_t groupAddr, bool nibble, bool error, Xn::FeedbackType inputType,
+	                         Xn::AccInputsState state);
+	void xnOnAccInputsChanged(Xn::AccInputChanges changes);
+
+private:
+	XpressNet &m_xn;
+	QThread m_thread;
+	MpscQueue<Task> m_tasks;
+	SpscRing<HostTask, _HOST_QUEUE_SIZE> m_host;
+	std::atomic<bool> m_running{false};
+	std::atomic<bool> m_tasksWake{false};
+	std::atomic<bool> m_hostWake{false};
+	std::atomic<bool> m_connected{false};
+	std::atomic<int> m_trkStatus{static_cast<int>(TrkStatus::Unknown)};
+	std::atomic<size_t> m_hostStalls{0};
+	bool m_hostInCall = false; // host thread only: 'call' or 'stop' is waiting
+
+	void execute(Task &task);
+	void drainTasks(); // engine thread
+	void drainHost(); // host thread
+	void refresh(); // engine thread
+};
+
+template <typename... Args>
+std::function<void(void *, Args...)> EngineThread::onHost(std::function<void(void *, Args...)> callback) {
+	if (callback == nullptr)
+		return nullptr;
+	return [this, callback](void *sender, Args... args) {
+		this->toHost([callback, sender, args...]() { callback(sender, args...); });
+	};
+}
+
+} // namespace Xn
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef XN_FEEDBACK_H
+#define XN_FEEDBACK_H
+
+/*
+This file defines state table of accessory decoders & feedback modules.
+
+XpressNET feedback broadcast reports state of a nibble (4 inputs) of a group
+(address 0-255) in a single byte: error flag, input type, nibble & inputs.
+FeedbackTable keeps the last received byte of each of 512 nibbles, the
+nibble bit replaced by 'known' flag (nibble was reported at least once).
+Bytes are packed into 64-bit words: a received byte is merged into its word
+& XORed with the old word, so changes are found by a single comparison.
+
+Table is written by the thread XpressNet runs on only & could be read from any
+thread without locking (words are relaxed atomics, as in xn-metrics.h).
+
+Changed nibbles are reported in batches too (AccInputChanges): per received
+frame or per coalescing window (XNConfig::feedbackWindow).
+*/
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace Xn {
+
+enum class FeedbackType {
+	accWithoutFb = 0,
+	accWithFb = 1,
+	fb = 2,
+	reserved = 3,
+};
+
+union AccInputsState {
+	uint8_t all;
+	struct {
+		bool i0 : 1;
+		bool i1 : 1;
+		bool i2 : 1;
+		bool i3 : 1;
+	} sep;
+};
+
+struct AccInputChange {
+	uint8_t groupAddr;
+	bool nibble;
+	bool error;
+	FeedbackType inputType;
+	AccInputsState state;
+};
+
+using AccInputChanges = std::vector<AccInputChange>; // in order of reception
+
+class FeedbackTable {
+public:
+	static constexpr size_t _GROUPS = 256;
+	static constexpr size_t _NIBBLES = 2*_GROUPS; // = bytes of the table
+	static constexpr size_t _WORDS = _NIBBLES / 8;
+
+	// Bits of nibble byte
+	static constexpr uint8_t _MASK_INPUTS = 0x0F;
+	static constexpr uint8_t _BIT_KNOWN = 0x10; // nibble bit of received byte
+	static constexpr uint8_t _MASK_TYPE = 0x60;
+	static constexpr uint8_t _BIT_ERROR = 0x80;
+
+	FeedbackTable() { clear(); }
+
+	// Stores byte of feedback broadcast, returns bits changed (0 = nothing changed)
+	uint8_t update(uint8_t groupAddr, uint8_t data) {
+		const size_t i = index(groupAddr, (data >> 4) & 0x1);
+		const unsigned shift = 8 * (i % 8);
+		std::atomic<uint64_t> &word = m_words[i / 8];
+		const uint64_t old = word.load(std::memory_order_relaxed);
+		const uint64_t value = (old & ~(uint64_t(0xFF) << shift)) |
+		                       (uint64_t(data | _BIT_KNOWN) << shift);
+		const uint64_t diff = old ^ value;
+		if (diff != 0)
+			word.store(value, std::memory_order_relaxed);
+		return static_cast<uint8_t>(diff >> shift);
+	}
+
+	uint8_t nibble(uint8_t groupAddr, bool nibble) const {
+		const size_t i = index(groupAddr, nibble);
+		return static_cast<uint8_t>(word(i / 8) >> (8 * (i % 8)));
+	}
+
+	bool known(uint8_t groupAddr, bool nibble) const {
+		return this->nibble(groupAddr, nibble) & _BIT_KNOWN;
+	}
+	bool error(uint8_t groupAddr, bool nibble) const {
+		return this->nibble(groupAddr, nibble) & _BIT_ERROR;
+	}
+	FeedbackType type(uint8_t groupAddr, bool nibble) const {
+		return static_cast<FeedbackType>((this->nibble(groupAddr, nibble) & _MASK_TYPE) >> 5);
+	}
+	AccInputsState inputs(uint8_t groupAddr, bool nibble) const {
+		AccInputsState state;
+		state.all = this->nibble(groupAddr, nibble) & _MASK_INPUTS;
+		return state;
+	}
+	// All 8 inputs of the group: lower nibble in bits 0-3, upper nibble in bits 4-7
+	uint8_t group(uint8_t groupAddr) const {
+		return static_cast<uint8_t>((this->nibble(groupAddr, false) & _MASK_INPUTS) |
+		                            ((this->nibble(groupAddr, true) & _MASK_INPUTS) << 4));
+	}
+
+	// Word 'i' contains nibbles 8*i .. 8*i+7 (nibble 2*groupAddr + nibble), lowest byte first
+	uint64_t word(size_t i) const { return m_words[i].load(std::memory_order_relaxed); }
+
+	void clear() {
+		for (std::atomic<uint64_t> &word : m_words)
+			word.store(0, std::memory_order_relaxed);
+	}
+
+private:
+	std::array<std::atomic<uint64_t>, _WORDS> m_words;
+
+	static size_t index(uint8_t groupAddr, bool nibble) {
+		return 2*static_cast<size_t>(groupAddr) + (nibble ? 1 : 0);
+	}
+};
+
+} // namespace Xn
+
+#endif
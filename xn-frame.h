@@ -0,0 +1,73 @@
+#ifndef XN_FRAME_H
+#define XN_FRAME_H
+
+/*
+This file defines XpressNET frame builder.
+Frame is a fixed-capacity inline byte buffer, so encoding & sending a command
+never touches the allocator. The buffer keeps a headroom for LI-USB-Ethernet
+header (0xFF 0xFE) and computes XOR checksum while bytes are appended.
+*/
+
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+
+#include "q-str-exception.h"
+
+namespace Xn {
+
+struct EFrameOverflow : public QStrException {
+	EFrameOverflow(const QString str) : QStrException(str) {}
+};
+
+class Frame {
+public:
+	static constexpr size_t _HEADROOM = 2; // LI-USB-Ethernet header 0xFF 0xFE
+	static constexpr size_t _MAX_MSG_LEN = 17; // header byte + 15 data bytes + xor
+	static constexpr size_t _CAPACITY = _HEADROOM + _MAX_MSG_LEN;
+
+	Frame() = default;
+	Frame(std::initializer_list<uint8_t> bytes) {
+		for (uint8_t byte : bytes)
+			push_back(byte);
+	}
+
+	void push_back(uint8_t byte) {
+		if (m_sealed || (m_end >= _CAPACITY))
+			throw EFrameOverflow("Frame capacity exceeded!");
+		m_buf[m_end++] = byte;
+		m_xor ^= byte;
+	}
+
+	// Appends XOR byte & optionally prepends LI-USB-Ethernet header into headroom.
+	// No more bytes could be added after sealing.
+	void seal(bool liHeader) {
+		push_back(m_xor);
+		m_sealed = true;
+		if (liHeader) {
+			m_buf[--m_begin] = 0xFE;
+			m_buf[--m_begin] = 0xFF;
+		}
+	}
+
+	uint8_t checksum() const { return m_xor; }
+	bool sealed() const { return m_sealed; }
+
+	const uint8_t *data() const { return m_buf.data() + m_begin; }
+	size_t size() const { return m_end - m_begin; }
+	bool empty() const { return m_end == m_begin; }
+	const uint8_t *begin() const { return data(); }
+	const uint8_t *end() const { return m_buf.data() + m_end; }
+	uint8_t operator[](size_t i) const { return m_buf[m_begin + i]; }
+
+private:
+	std::array<uint8_t, _CAPACITY> m_buf;
+	uint8_t m_begin = _HEADROOM;
+	uint8_t m_end = _HEADROOM;
+	uint8_t m_xor = 0;
+	bool m_sealed = false;
+};
+
+} // namespace Xn
+
+#endif
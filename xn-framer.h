@@ -0,0 +1,164 @@
+#ifndef XN_FRAMER_H
+#define XN_FRAMER_H
+
+/*
+This file defines receive framer of XpressNET messages.
+Framer stores received bytes in a fixed-capacity ring buffer & cuts frames
+out of it in place: (optional LI-USB-Ethernet 0xFF 0xFE/0xFD header), header
+byte with length in lower nibble, data, XOR. Bytes are never shifted in the
+buffer. When a frame is not valid (missing LI header, XOR error), just a single
+byte is skipped & framing continues with the next one (resync).
+Frames are passed to the parser as MsgView: a non-owning view of the bytes
+with bounds-checked access. MsgView is valid until next data are read.
+*/
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "q-str-exception.h"
+
+namespace Xn {
+
+struct EInvalidMsg : public QStrException {
+	EInvalidMsg(const QString str) : QStrException(str) {}
+};
+
+class MsgView {
+public:
+	MsgView() = default;
+	MsgView(const uint8_t *data, size_t size) : m_data(data), m_size(size) {}
+
+	uint8_t operator[](size_t i) const {
+		if (i >= m_size)
+			throw EInvalidMsg("Message too short: byte "+QString::number(i)+" requested, length "+
+			                  QString::number(m_size)+"!");
+		return m_data[i];
+	}
+
+	const uint8_t *data() const { return m_data; }
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+	const uint8_t *begin() const { return m_data; }
+	const uint8_t *end() const { return m_data + m_size; }
+
+	std::vector<uint8_t> copy() const { return std::vector<uint8_t>(begin(), end()); }
+
+private:
+	const uint8_t *m_data = nullptr;
+	size_t m_size = 0;
+};
+
+enum class FrameResult {
+	NeedMore, // no complete frame in buffer
+	Ok,
+	XorError, // first byte of the candidate frame was skipped
+};
+
+struct ReceiveStats {
+	uint64_t frames = 0;
+	uint64_t xorErrors = 0;
+	uint64_t resyncBytes = 0; // bytes skipped when looking for a valid frame
+	uint64_t overflows = 0; // serial port read buffer full (data could be lost)
+	uint64_t timeouts = 0; // incomplete data dropped after _BUF_IN_TIMEOUT
+};
+
+class Framer {
+public:
+	static constexpr size_t _CAPACITY = 1024; // must be power of 2
+	static constexpr size_t _LI_HEADER_LEN = 2;
+	static constexpr size_t _MAX_MSG_LEN = 17; // header byte + 15 data bytes + xor
+
+	void setLiHeader(bool liHeader) { m_liHeader = liHeader; }
+	void clear() { m_head = m_tail; }
+
+	size_t size() const { return m_tail - m_head; }
+	bool empty() const { return m_tail == m_head; }
+	size_t space() const { return _CAPACITY - size(); }
+
+	// Contiguous free space to read data into; call 'commit' afterwards.
+	std::pair<uint8_t *, size_t> writable() {
+		const size_t pos = m_tail & _MASK;
+		return {m_buf.data() + pos, std::min(space(), _CAPACITY - pos)};
+	}
+	void commit(size_t len) { m_tail += len; }
+
+	// Copies as many bytes as possible into the buffer, returns number of bytes copied.
+	size_t append(const uint8_t *data, size_t len) {
+		size_t copied = 0;
+		while (copied < len && space() > 0) {
+			auto free = writable();
+			const size_t chunk = std::min(free.second, len - copied);
+			std::copy(data + copied, data + copied + chunk, free.first);
+			commit(chunk);
+			copied += chunk;
+		}
+		return copied;
+	}
+
+	// Cuts next frame out of the buffer, 'msg' views it (without LI header).
+	// On XorError, 'msg' views the rejected candidate frame.
+	FrameResult next(MsgView &msg) {
+		const size_t hdr = m_liHeader ? _LI_HEADER_LEN : 0;
+		while (size() > hdr) {
+			if (m_liHeader && (at(0) != 0xFF || (at(1) != 0xFE && at(1) != 0xFD))) {
+				drop(1);
+				m_stats.resyncBytes++;
+				continue;
+			}
+
+			const size_t length = (at(hdr) & 0x0F) + 2U; // including header byte & xor
+			if (size() < hdr + length)
+				return FrameResult::NeedMore;
+
+			uint8_t x = 0;
+			for (size_t i = hdr; i < hdr + length; i++)
+				x ^= at(i);
+			msg = view(hdr, length);
+
+			if (x != 0) {
+				drop(1);
+				m_stats.xorErrors++;
+				m_stats.resyncBytes++;
+				return FrameResult::XorError;
+			}
+
+			drop(hdr + length);
+			m_stats.frames++;
+			return FrameResult::Ok;
+		}
+		return FrameResult::NeedMore;
+	}
+
+	ReceiveStats &stats() { return m_stats; }
+	const ReceiveStats &stats() const { return m_stats; }
+
+private:
+	static constexpr size_t _MASK = _CAPACITY - 1;
+	static_assert((_CAPACITY & _MASK) == 0, "Framer capacity must be power of 2!");
+
+	std::array<uint8_t, _CAPACITY> m_buf;
+	std::array<uint8_t, _MAX_MSG_LEN> m_wrapped; // frame crossing end of m_buf
+	size_t m_head = 0; // monotonic, index = m_head & _MASK
+	size_t m_tail = 0;
+	bool m_liHeader = false;
+	ReceiveStats m_stats;
+
+	uint8_t at(size_t i) const { return m_buf[(m_head + i) & _MASK]; }
+	void drop(size_t len) { m_head += len; }
+
+	MsgView view(size_t offset, size_t len) {
+		const size_t pos = (m_head + offset) & _MASK;
+		if (pos + len <= _CAPACITY)
+			return MsgView(m_buf.data() + pos, len);
+		for (size_t i = 0; i < len; i++)
+			m_wrapped[i] = at(offset + i);
+		return MsgView(m_wrapped.data(), len);
+	}
+};
+
+} // namespace Xn
+
+#endif
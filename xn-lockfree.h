@@ -0,0 +1,129 @@
+#ifndef XN_LOCKFREE_H
+#define XN_LOCKFREE_H
+
+/*
+This file defines lock-free queues used to pass work between threads of
+XpressNet engine (see xn-engine-thread.h).
+
+MpscQueue: unbounded multi-producer single-consumer queue (D. Vyukov's
+intrusive node-based algorithm). 'push' is wait-free (one atomic exchange),
+'pop' never blocks. Items pushed by a single producer are popped in the order
+they were pushed.
+
+SpscRing: bounded single-producer single-consumer ring buffer. 'push' fails
+when the ring is full, so the producer decides what to do (wait, drop).
+*/
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace Xn {
+
+template <typename T>
+class MpscQueue {
+public:
+	MpscQueue() : m_head(&m_stub), m_tail(&m_stub) {}
+	~MpscQueue() {
+		T value;
+		while (this->pop(value)) {}
+	}
+	MpscQueue(const MpscQueue &) = delete;
+	MpscQueue &operator=(const MpscQueue &) = delete;
+
+	// Any thread
+	void push(T value) {
+		Node *node = new Node(std::move(value));
+		this->link(node);
+	}
+
+	// Consumer thread only. Returns false when the queue is empty or when
+	// a producer has not finished its 'push' yet (the producer is expected to
+	// wake the consumer after 'push' returns).
+	bool pop(T &value) {
+		Node *tail = m_tail;
+		Node *next = tail->next.load(std::memory_order_acquire);
+		if (tail == &m_stub) {
+			if (next == nullptr)
+				return false;
+			m_tail = next;
+			tail = next;
+			next = next->next.load(std::memory_order_acquire);
+		}
+		if (next == nullptr) {
+			if (tail != m_head.load(std::memory_order_acquire))
+				return false; // producer in the middle of push
+			m_stub.next.store(nullptr, std::memory_order_relaxed);
+			this->link(&m_stub);
+			next = tail->next.load(std::memory_order_acquire);
+			if (next == nullptr)
+				return false;
+		}
+		m_tail = next;
+		value = std::move(tail->value);
+		delete tail;
+		return true;
+	}
+
+private:
+	struct Node {
+		std::atomic<Node *> next{nullptr};
+		T value;
+
+		Node() = default;
+		explicit Node(T &&value) : value(std::move(value)) {}
+	};
+
+	Node m_stub;
+	std::atomic<Node *> m_head; // producers push here
+	Node *m_tail; // consumer pops here
+
+	void link(Node *node) {
+		Node *prev = m_head.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node, std::memory_order_release);
+	}
+};
+
+// Capacity must be a power of 2.
+template <typename T, size_t Capacity>
+class SpscRing {
+	static_assert((Capacity > 0) && ((Capacity & (Capacity - 1)) == 0),
+	              "SpscRing capacity must be a power of 2");
+
+public:
+	SpscRing() : m_buf(Capacity) {}
+	SpscRing(const SpscRing &) = delete;
+	SpscRing &operator=(const SpscRing &) = delete;
+
+	// Producer thread only; false iff full ('value' is left untouched then)
+	bool push(T &value) {
+		const size_t head = m_head.load(std::memory_order_relaxed);
+		if (head - m_tail.load(std::memory_order_acquire) >= Capacity)
+			return false;
+		m_buf[head & (Capacity - 1)] = std::move(value);
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer thread only; false iff empty
+	bool pop(T &value) {
+		const size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail == m_head.load(std::memory_order_acquire))
+			return false;
+		value = std::move(m_buf[tail & (Capacity - 1)]);
+		m_buf[tail & (Capacity - 1)] = T(); // release resources held by the slot
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	static constexpr size_t capacity() { return Capacity; }
+
+private:
+	std::vector<T> m_buf;
+	alignas(64) std::atomic<size_t> m_head{0}; // written by producer
+	alignas(64) std::atomic<size_t> m_tail{0}; // written by consumer
+};
+
+} // namespace Xn
+
+#endif
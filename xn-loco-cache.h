@@ -0,0 +1,158 @@
+#ifndef XN_LOCO_CACHE_H
+#define XN_LOCO_CACHE_H
+
+/*
+This file defines cache of locomotive states kept by the XpressNet engine.
+
+There is an entry for each loco address 0-9999: speed & direction, functions
+F0-F28 & "used by another device" flag. Commands & responses carry only parts
+of the state (e.g. loco information contains F0-F12, F13-F28 come in separate
+response), so each part is marked as known separately. Entries are updated by
+acknowledged speed & function commands and by loco information responses;
+loco stolen by another device is invalidated. Only a loco we have commanded
+is 'controlled': the command station notifies us when another device takes
+it over, a loco we have just queried could change without any notice.
+
+The cache does not decide whether its entries are fresh enough to answer
+queries, see LocoCachePolicy in xn.h.
+*/
+
+#include <memory>
+
+#include "xn-clock.h"
+#include "xn-commands.h"
+#include "xn-loco-addr.h"
+
+namespace Xn {
+
+constexpr size_t _LOCO_ADDR_COUNT = 10000;
+
+struct LocoState {
+	enum Part : uint8_t {
+		Speed = 0x01, // speed & direction
+		Used = 0x02, // used by another device
+		FuncA = 0x04, // F0-F4
+		FuncB58 = 0x08,
+		FuncB912 = 0x10,
+		FuncC = 0x20, // F13-F20
+		FuncD = 0x40, // F21-F28
+	};
+	static constexpr uint8_t INFO = Speed | Used | FuncA | FuncB58 | FuncB912; // loco information
+	static constexpr uint8_t FUNC1328 = FuncC | FuncD;
+	static constexpr uint8_t ALL = INFO | FUNC1328;
+
+	uint8_t known = 0; // parts of the state known
+	uint8_t speed = 0; // 28 speed steps
+	Direction direction = Direction::Forward;
+	bool used = false;
+	FA fa;
+	FB fb;
+	FC fc;
+	FD fd;
+	Timestamp updated = 0; // last update of any part
+	bool controlled = false; // acknowledged command of ours, stolen is reported
+
+	bool has(uint8_t parts) const { return (known & parts) == parts; }
+};
+
+class LocoCache {
+public:
+	LocoCache() : m_locos(new LocoState[_LOCO_ADDR_COUNT]) {}
+
+	const LocoState &operator[](LocoAddr addr) const { return m_locos[addr.addr]; }
+
+	// Acknowledged command: state of the loco is what we have set
+	void acknowledged(const Cmd &cmd, Timestamp now) {
+		switch (cmd.type()) {
+		case CmdType::SetSpeedDir: {
+			const auto &set = as<CmdSetSpeedDir>(cmd);
+			LocoState &state = control(set.loco, LocoState::Speed | LocoState::Used, now);
+			state.speed = static_cast<uint8_t>(set.speed);
+			state.direction = set.dir;
+			state.used = false;
+			break;
+		}
+		case CmdType::EmergencyStopLoco: {
+			// Direction is not part of the command: speed known only if it was known
+			LocoState &state = control(as<CmdEmergencyStopLoco>(cmd).loco, 0, now);
+			if (state.has(LocoState::Speed))
+				state.speed = 0;
+			break;
+		}
+		case CmdType::SetFuncA: {
+			const auto &set = as<CmdSetFuncA>(cmd);
+			control(set.loco, LocoState::FuncA, now).fa = set.fa;
+			break;
+		}
+		case CmdType::SetFuncB: {
+			const auto &set = as<CmdSetFuncB>(cmd);
+			const bool low = (set.range == FSet::F5toF8);
+			LocoState &state = control(set.loco, low ? LocoState::FuncB58 : LocoState::FuncB912, now);
+			const uint8_t mask = low ? 0x0F : 0xF0;
+			state.fb.all = static_cast<uint8_t>((state.fb.all & ~mask) | (set.fb.all & mask));
+			break;
+		}
+		case CmdType::SetFuncC: {
+			const auto &set = as<CmdSetFuncC>(cmd);
+			control(set.loco, LocoState::FuncC, now).fc = set.fc;
+			break;
+		}
+		case CmdType::SetFuncD: {
+			const auto &set = as<CmdSetFuncD>(cmd);
+			control(set.loco, LocoState::FuncD, now).fd = set.fd;
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	void info(LocoAddr addr, bool used, Direction direction, unsigned speed, FA fa, FB fb,
+	          Timestamp now) {
+		LocoState &state = update(addr, LocoState::INFO, now);
+		state.used = used;
+		state.direction = direction;
+		state.speed = static_cast<uint8_t>(speed);
+		state.fa = fa;
+		state.fb = fb;
+	}
+
+	void func1328(LocoAddr addr, FC fc, FD fd, Timestamp now) {
+		LocoState &state = update(addr, LocoState::FUNC1328, now);
+		state.fc = fc;
+		state.fd = fd;
+	}
+
+	void invalidate(LocoAddr addr) { m_locos[addr.addr] = LocoState(); }
+
+	// Forgets 'parts' of all locos (e.g. speeds after emergency stop)
+	void forget(uint8_t parts) {
+		for (size_t i = 0; i < _LOCO_ADDR_COUNT; i++)
+			m_locos[i].known &= static_cast<uint8_t>(~parts);
+	}
+
+	void clear() {
+		for (size_t i = 0; i < _LOCO_ADDR_COUNT; i++)
+			m_locos[i] = LocoState();
+	}
+
+private:
+	std::unique_ptr<LocoState[]> m_locos; // ~16 B per address -> heap
+
+	LocoState &update(LocoAddr addr, uint8_t parts, Timestamp now) {
+		LocoState &state = m_locos[addr.addr];
+		state.known |= parts;
+		state.updated = now;
+		return state;
+	}
+
+	LocoState &control(LocoAddr addr, uint8_t parts, Timestamp now) {
+		LocoState &state = update(addr, parts, now);
+		state.controlled = true;
+		return state;
+	}
+};
+
+} // namespace Xn
+
+#endif
@@ -0,0 +1,222 @@
+#ifndef XN_METRICS_H
+#define XN_METRICS_H
+
+/*
+This file defines runtime metrics of the XpressNet engine.
+
+Engine-wide counters & gauges (queue depths, commands in flight, pacing rate,
+response time) describe current state of the engine. For each command type
+the engine counts transmissions, responses, errors,
+timeouts & conflict deferrals and records durations into HDR-style
+histograms: time spent in the outgoing queue & time from the (last)
+transmission to the response. Number of retries of finished commands is
+recorded too. XOR errors & framing resyncs of the receive path are mirrored
+from the framer.
+
+Metrics are written by the thread XpressNet runs on only & could be read from
+any thread without locking (all values are relaxed atomics). Values read
+concurrently are not a consistent snapshot, each of them is correct though.
+*/
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "xn-commands.h"
+#include "xn-framer.h"
+
+namespace Xn {
+
+using Counter = std::atomic<uint64_t>;
+using Gauge = std::atomic<uint64_t>;
+
+constexpr size_t _METRICS_RETRIES = 4; // retries histogram: 0, 1, 2, 3 or more retries
+
+// Single writer: cheaper than atomic read-modify-write
+inline void bump(Counter &counter, uint64_t by = 1) {
+	counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+}
+
+// Log-linear histogram of durations [us]: values below _SUB are recorded
+// exactly, each power of 2 above is split into _SUB linear sub-buckets, so
+// relative error of a recorded value is below 1/_SUB.
+class LatencyHistogram {
+public:
+	static constexpr unsigned _SUB_BITS = 4;
+	static constexpr uint64_t _SUB = 1 << _SUB_BITS;
+	static constexpr unsigned _MAX_BITS = 32; // values up to ~71 minutes
+	static constexpr size_t _BUCKETS = (_MAX_BITS - _SUB_BITS + 1) * _SUB;
+
+	LatencyHistogram() { reset(); }
+
+	void record(uint64_t value) {
+		bump(m_buckets[bucket(value)]);
+		bump(m_count);
+		bump(m_sum, value);
+		if (value > m_max.load(std::memory_order_relaxed))
+			m_max.store(value, std::memory_order_relaxed);
+	}
+
+	void reset() {
+		for (Counter &bucket : m_buckets)
+			bucket.store(0, std::memory_order_relaxed);
+		m_count.store(0, std::memory_order_relaxed);
+		m_sum.store(0, std::memory_order_relaxed);
+		m_max.store(0, std::memory_order_relaxed);
+	}
+
+	uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+	uint64_t sum() const { return m_sum.load(std::memory_order_relaxed); }
+	uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+	uint64_t bucketCount(size_t i) const { return m_buckets[i].load(std::memory_order_relaxed); }
+
+	// Upper bound of the bucket containing q-quantile (0 <= q <= 1), 0 iff empty
+	uint64_t percentile(double q) const {
+		const uint64_t count = this->count();
+		if (count == 0)
+			return 0;
+		const uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(q * count + 0.5), 1);
+		uint64_t seen = 0;
+		for (size_t i = 0; i < _BUCKETS; i++) {
+			seen += bucketCount(i);
+			if (seen >= rank)
+				return std::min(bucketMax(i), this->max());
+		}
+		return this->max();
+	}
+
+	static size_t bucket(uint64_t value) {
+		if (value < _SUB)
+			return static_cast<size_t>(value);
+		if (value >= (uint64_t(1) << _MAX_BITS))
+			return _BUCKETS - 1;
+		unsigned msb = _SUB_BITS;
+		while ((value >> (msb + 1)) != 0)
+			msb++;
+		return static_cast<size_t>((msb - _SUB_BITS + 1) * _SUB +
+		                           ((value >> (msb - _SUB_BITS)) & (_SUB - 1)));
+	}
+
+	static uint64_t bucketMax(size_t i) {
+		if (i < _SUB)
+			return i;
+		const unsigned shift = static_cast<unsigned>(i / _SUB) - 1;
+		const uint64_t lower = (_SUB + (i % _SUB)) << shift;
+		return lower + (uint64_t(1) << shift) - 1;
+	}
+
+private:
+	std::array<Counter, _BUCKETS> m_buckets;
+	Counter m_count;
+	Counter m_sum;
+	Counter m_max;
+};
+
+struct CmdMetrics {
+	Counter sent; // first transmissions
+	Counter retransmissions;
+	Counter responses; // 'ok' responses from the LI or the command station
+	Counter errors; // commands finished with 'error' callback
+	Counter timeouts; // no response after _PENDING_SEND_MAX transmissions
+	Counter conflictDeferrals; // queued because of conflict with a pending command
+	LatencyHistogram queued; // time in the outgoing queue [us], 0 = sent immediately
+	LatencyHistogram rtt; // time from the last transmission to the response [us]
+	std::array<Counter, _METRICS_RETRIES> retries; // finished commands by number of retries
+
+	CmdMetrics() { reset(); }
+
+	void reset() {
+		for (Counter *counter : {&sent, &retransmissions, &responses, &errors, &timeouts,
+		                         &conflictDeferrals})
+			counter->store(0, std::memory_order_relaxed);
+		for (Counter &counter : retries)
+			counter.store(0, std::memory_order_relaxed);
+		queued.reset();
+		rtt.reset();
+	}
+};
+
+struct ReceiveMetrics {
+	Counter frames;
+	Counter xorErrors;
+	Counter resyncBytes;
+	Counter overflows;
+	Counter timeouts;
+
+	ReceiveMetrics() { update(ReceiveStats()); }
+
+	void update(const ReceiveStats &stats) {
+		frames.store(stats.frames, std::memory_order_relaxed);
+		xorErrors.store(stats.xorErrors, std::memory_order_relaxed);
+		resyncBytes.store(stats.resyncBytes, std::memory_order_relaxed);
+		overflows.store(stats.overflows, std::memory_order_relaxed);
+		timeouts.store(stats.timeouts, std::memory_order_relaxed);
+	}
+};
+
+struct EngineMetrics {
+	Counter framesSent;
+	Counter bytesSent;
+	Counter bytesReceived;
+	std::array<Gauge, _CMD_PRIORITY_COUNT> outDepth; // commands waiting in lanes of outgoing queue
+	Gauge inFlight; // commands sent with no response yet
+	Gauge pacingRate; // frames per 1000 s currently allowed by pacing (speed command frame)
+	Gauge lastRtt; // [us] response time of the last answered command
+	Gauge avgRtt; // [us] moving average of response time used by pacing
+
+	EngineMetrics() {
+		for (Counter *counter : {&framesSent, &bytesSent, &bytesReceived, &inFlight, &pacingRate,
+		                         &lastRtt, &avgRtt})
+			counter->store(0, std::memory_order_relaxed);
+		for (Gauge &depth : outDepth)
+			depth.store(0, std::memory_order_relaxed);
+	}
+
+	void reset() {
+		for (Counter *counter : {&framesSent, &bytesSent, &bytesReceived})
+			counter->store(0, std::memory_order_relaxed);
+	}
+};
+
+class Metrics {
+public:
+	Metrics() : m_cmds(new CmdMetrics[_CMD_TYPE_COUNT]) {}
+
+	CmdMetrics &cmd(CmdType type) { return m_cmds[static_cast<size_t>(type)]; }
+	const CmdMetrics &cmd(CmdType type) const { return m_cmds[static_cast<size_t>(type)]; }
+	ReceiveMetrics &receive() { return m_receive; }
+	const ReceiveMetrics &receive() const { return m_receive; }
+	EngineMetrics &engine() { return m_engine; }
+	const EngineMetrics &engine() const { return m_engine; }
+
+	// Totals over all command types
+	uint64_t total(Counter CmdMetrics::*counter) const {
+		uint64_t sum = 0;
+		for (size_t i = 0; i < _CMD_TYPE_COUNT; i++)
+			sum += (m_cmds[i].*counter).load(std::memory_order_relaxed);
+		return sum;
+	}
+
+	void finished(CmdType type, size_t no_sent) {
+		CmdMetrics &metrics = cmd(type);
+		const size_t retries = (no_sent > 0) ? no_sent - 1 : 0;
+		bump(metrics.retries[std::min(retries, metrics.retries.size() - 1)]);
+	}
+
+	void reset() {
+		for (size_t i = 0; i < _CMD_TYPE_COUNT; i++)
+			m_cmds[i].reset();
+		m_engine.reset();
+	}
+
+private:
+	std::unique_ptr<CmdMetrics[]> m_cmds; // ~7 kB per command type -> heap
+	ReceiveMetrics m_receive;
+	EngineMetrics m_engine;
+};
+
+} // namespace Xn
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef XN_PACER_H
+#define XN_PACER_H
+
+/*
+This file defines adaptive pacing of outgoing frames.
+
+Pacer is a token bucket measured in microseconds of "bus time". Each frame
+costs its time on the wire at the configured baud rate plus a service time
+of the LI & command station. Service time is derived from measured response
+times (exponentially weighted moving average) divided by the number of
+commands allowed in flight. Bucket refills with real time up to 'burst', so
+idle gaps are used for short bursts of frames.
+*/
+
+#include <algorithm>
+#include <cstdint>
+
+#include "xn-clock.h"
+
+namespace Xn {
+
+class Pacer {
+public:
+	static constexpr unsigned _BITS_PER_BYTE = 10; // 8N1: start bit + 8 data bits + stop bit
+	static constexpr unsigned _RTT_EWMA_SHIFT = 3; // new sample weight = 1/8
+
+	void configure(unsigned baudrate, size_t window, Timestamp burst, Timestamp initialRtt) {
+		m_byteTime = (baudrate > 0) ? (1000000LL * _BITS_PER_BYTE) / baudrate : 0;
+		m_window = std::max<size_t>(window, 1);
+		m_burst = burst;
+		m_rtt = initialRtt;
+		m_tokens = burst;
+		m_refilled = 0;
+	}
+
+	// Returns time to wait before a frame of 'bytes' length could be sent.
+	Timestamp delay(size_t bytes, Timestamp now) {
+		refill(now);
+		const Timestamp c = cost(bytes);
+		return (m_tokens >= c) ? 0 : c - m_tokens;
+	}
+
+	void sent(size_t bytes, Timestamp now) {
+		refill(now);
+		m_tokens -= cost(bytes);
+	}
+
+	// Response time of a command sent exactly once (retransmissions are not
+	// measured, their response could belong to any of the transmissions).
+	void responded(Timestamp rtt) {
+		m_rtt += (rtt - m_rtt) / (1 << _RTT_EWMA_SHIFT);
+	}
+
+	Timestamp rtt() const { return m_rtt; }
+
+	// Currently budgeted frames per second for frames of 'bytes' length.
+	double rate(size_t bytes) const {
+		const Timestamp c = cost(bytes);
+		return (c > 0) ? 1e6 / c : 0;
+	}
+
+private:
+	Timestamp m_byteTime = 0;
+	size_t m_window = 1;
+	Timestamp m_burst = 0;
+	Timestamp m_rtt = 0;
+	Timestamp m_tokens = 0;
+	Timestamp m_refilled = 0;
+
+	Timestamp cost(size_t bytes) const {
+		return static_cast<Timestamp>(bytes)*m_byteTime + m_rtt/static_cast<Timestamp>(m_window);
+	}
+
+	void refill(Timestamp now) {
+		if (m_refilled != 0)
+			m_tokens = std::min(m_burst, m_tokens + (now - m_refilled));
+		m_refilled = now;
+	}
+};
+
+} // namespace Xn
+
+#endif
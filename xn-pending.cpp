@@ -12,8 +12,25 @@ void XpressNet::pending_ok() {
 		return;
 	}
 
-	PendingItem pending = std::move(m_pending.front());
-	m_pending.pop_front();
+	pending_ok(m_pending.begin());
+}
+
+void XpressNet::pending_ok(CmdQueue::iterator it) {
+	PendingItem pending = std::move(*it);
+	m_pending.erase(it);
+	pending_removed();
+	if (pending.no_sent == 1) {
+		m_pacer.responded(now() - pending.sent);
+		this->metrics_pacing();
+	}
+	CmdMetrics &metrics = m_metrics.cmd(pending.type);
+	bump(metrics.responses);
+	metrics.rtt.record(static_cast<uint64_t>(now() - pending.sent));
+	m_metrics.engine().lastRtt.store(static_cast<uint64_t>(now() - pending.sent),
+	                                 std::memory_order_relaxed);
+	m_metrics.finished(pending.type, pending.no_sent);
+	if (pending.cmd != nullptr) // responses with data move the command out
+		m_locos.acknowledged(*(pending.cmd), now());
 	if (nullptr != pending.callback_ok)
 		pending.callback_ok->func(this, pending.callback_ok->data);
 	if (!m_out.empty())
@@ -25,10 +42,16 @@ void XpressNet::pending_err(bool _log) {
 		log("Pending buffer underflow!", LogLevel::Warning);
 		return;
 	}
+	pending_err(m_pending.begin(), _log);
+}
 
-	PendingItem pending = std::move(m_pending.front());
-	m_pending.pop_front();
+void XpressNet::pending_err(CmdQueue::iterator it, bool _log) {
+	PendingItem pending = std::move(*it);
+	m_pending.erase(it);
+	pending_removed();
 
+	bump(m_metrics.cmd(pending.type).errors);
+	m_metrics.finished(pending.type, pending.no_sent);
 	if (_log)
 		log("Not responded to command: " + pending.cmd->msg(), LogLevel::Error);
 
@@ -38,15 +61,19 @@ void XpressNet::pending_err(bool _log) {
 		send_next_out();
 }
 
-void XpressNet::pending_send() {
-	PendingItem pending = std::move(m_pending.front());
-	m_pending.pop_front();
+void XpressNet::pending_send(CmdQueue::iterator it) {
+	PendingItem pending = std::move(*it);
+	m_pending.erase(it);
+	pending_removed();
 
 	// to_send guarantees us that conflict can never occur in pending buffer
-	// we just check conflict in out buffer
+	// we just check conflict in out buffer; a queued loco query asks for
+	// another loco, it does not supersede this one
 
-	if (this->conflictWithOut(*(pending.cmd))) {
+	if ((!isLocoQuery(pending.type)) && (this->conflictWithOut(*(pending.cmd)))) {
 		log("Not sending again, conflict: " + pending.cmd->msg(), LogLevel::Warning);
+		bump(m_metrics.cmd(pending.type).errors);
+		m_metrics.finished(pending.type, pending.no_sent);
 		if (nullptr != pending.callback_err)
 			pending.callback_err->func(this, pending.callback_err->data);
 		if (!m_out.empty())
@@ -61,21 +88,69 @@ void XpressNet::pending_send() {
 	} catch (...) {}
 }
 
-void XpressNet::m_pending_timer_tick() {
-	if (!m_serialPort.isOpen()) {
-		while (!m_pending.empty())
-			pending_err();
+void XpressNet::pending_push(std::unique_ptr<const Cmd> &cmd, size_t no_sent, UPCb &&ok,
+                             UPCb &&err, UPCb &&superseded) {
+	m_pending.emplace_back(cmd, timeout(cmd.get()), no_sent, std::move(ok), std::move(err),
+	                       std::move(superseded));
+	PendingItem &pending = m_pending.back();
+	pending.sent = now();
+	pending.id = ++m_pending_seq;
+
+	const bool earliest = m_deadlines.empty() || (pending.timeout < m_deadlines.top().deadline);
+	m_deadlines.push(pending.timeout, pending.id);
+	if (earliest)
+		pending_timer_arm();
+	this->metrics_gauges();
+}
+
+void XpressNet::pending_removed() {
+	// Deadlines of items still pending stay in the heap, stale entries are
+	// dropped when they get to the top. No wakeups with empty pending buffer.
+	if (m_pending.empty()) {
+		m_deadlines.clear();
+		m_pending_timer.stop();
 	}
+	this->metrics_gauges();
+}
 
-	if (m_pending.empty())
+void XpressNet::pending_timer_arm() {
+	// Arms single-shot timer for the earliest timeout of a pending item
+	while (!m_deadlines.empty() && (m_pending.find(m_deadlines.top().id) == m_pending.end()))
+		m_deadlines.pop();
+
+	if (m_deadlines.empty()) {
+		m_pending_timer.stop();
 		return;
+	}
 
-	if (m_pending.front().timeout < QDateTime::currentDateTime()) {
-		if (m_pending.front().no_sent >= _PENDING_SEND_MAX)
+	const Timestamp wait = m_deadlines.top().deadline - now();
+	m_pending_timer.start((wait > 0) ? static_cast<int>((wait + 999) / 1000) : 0);
+}
+
+void XpressNet::m_pending_timer_tick() {
+	if (!this->connected()) {
+		while (!m_pending.empty())
 			pending_err();
-		else
-			pending_send();
+		return;
 	}
+
+	// Handles all expired items, not just the head of the pending buffer
+	const Timestamp time = now();
+	while (!m_deadlines.empty() && (m_deadlines.top().deadline <= time)) {
+		const uint64_t id = m_deadlines.top().id;
+		m_deadlines.pop();
+
+		auto it = m_pending.find(id);
+		if (it == m_pending.end())
+			continue; // already responded
+		if (it->no_sent >= _PENDING_SEND_MAX) {
+			bump(m_metrics.cmd(it->type).timeouts);
+			pending_err(it);
+		} else
+			pending_send(it);
+	}
+
+	pending_timer_arm();
 }
 
 void XpressNet::pendingClear() {
@@ -85,17 +160,11 @@ void XpressNet::pendingClear() {
 }
 
 bool XpressNet::conflictWithPending(const Cmd &cmd) const {
-	for (const PendingItem &pending : m_pending)
-		if (pending.cmd->conflict(cmd) || cmd.conflict(*(pending.cmd)))
-			return true;
-	return false;
+	return m_pending.conflict(cmd);
 }
 
 bool XpressNet::conflictWithOut(const Cmd &cmd) const {
-	for (const PendingItem &out : m_out)
-		if (out.cmd->conflict(cmd) || cmd.conflict(*(out.cmd)))
-			return true;
-	return false;
+	return m_out.conflict(cmd);
 }
 
 } // namespace Xn
@@ -0,0 +1,302 @@
+#ifndef XN_QUEUE_H
+#define XN_QUEUE_H
+
+/*
+This file defines queues of commands waiting for sending or for response.
+Each queue keeps an index of conflict keys of its items (see xn-commands.h),
+so checking a command for conflict with a queue costs O(1) regardless of
+queue depth.
+
+Outgoing queue is split into lanes by command priority (see CmdPriority).
+Lanes are served by strict priority, the lowest lane is guaranteed to be
+served at least once per _OUT_STARVATION_LIMIT dequeues.
+*/
+
+#include <array>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+#include "xn-commands.h"
+#include "xn-clock.h"
+
+namespace Xn {
+
+constexpr size_t _OUT_STARVATION_LIMIT = 8; // higher-lane dequeues before the lowest lane is served
+
+using CommandCallbackFunc = std::function<void(void *sender, void *data)>;
+
+struct CommandCallback {
+	CommandCallbackFunc const func;
+	void *const data;
+
+	CommandCallback(CommandCallbackFunc const func, void *const data = nullptr)
+	    : func(func), data(data) {}
+};
+
+using Cb = CommandCallback;
+using UPCb = std::unique_ptr<CommandCallback>;
+
+// PendingItem represents a command sent to the LI, for which the response
+// has not arrived yet.
+struct PendingItem {
+	PendingItem(std::unique_ptr<const Cmd> &cmd, Timestamp timeout, size_t no_sent,
+	            std::unique_ptr<Cb> &&callback_ok, std::unique_ptr<Cb> &&callback_err,
+	            std::unique_ptr<Cb> &&callback_superseded = nullptr)
+	    : cmd(std::move(cmd))
+	    , type(this->cmd->type())
+	    , held(this->cmd->heldKeys())
+	    , timeout(timeout)
+	    , no_sent(no_sent)
+	    , callback_ok(std::move(callback_ok))
+	    , callback_err(std::move(callback_err))
+	    , callback_superseded(std::move(callback_superseded)) {}
+	PendingItem(PendingItem &&pending) noexcept
+	    : cmd(std::move(pending.cmd))
+	    , type(pending.type)
+	    , held(pending.held)
+	    , timeout(pending.timeout)
+	    , no_sent(pending.no_sent)
+	    , callback_ok(std::move(pending.callback_ok))
+	    , callback_err(std::move(pending.callback_err))
+	    , callback_superseded(std::move(pending.callback_superseded))
+	    , sent(pending.sent)
+	    , queued(pending.queued)
+	    , id(pending.id) {}
+	PendingItem &operator=(PendingItem &&) = default;
+
+	std::unique_ptr<const Cmd> cmd;
+	CmdType type; // cached as 'held'
+	ConflictKeys held; // cached, cmd could be moved out before item is removed from queue
+	Timestamp timeout;
+	size_t no_sent;
+	std::unique_ptr<Cb> callback_ok;
+	std::unique_ptr<Cb> callback_err;
+	std::unique_ptr<Cb> callback_superseded; // see XNConfig::coalesce
+	Timestamp sent = 0; // time of the last transmission
+	Timestamp queued = 0; // time of entering the outgoing queue
+	uint64_t id = 0; // unique in pending queue, see DeadlineHeap
+};
+
+class ConflictIndex {
+public:
+	void add(const ConflictKeys &keys) {
+		for (ConflictKey key : keys)
+			m_held[key]++;
+	}
+
+	void remove(const ConflictKeys &keys) {
+		for (ConflictKey key : keys) {
+			auto it = m_held.find(key);
+			if (it == m_held.end())
+				continue;
+			if (--(it->second) == 0)
+				m_held.erase(it);
+		}
+	}
+
+	bool contains(const ConflictKeys &keys) const {
+		for (ConflictKey key : keys)
+			if (m_held.find(key) != m_held.end())
+				return true;
+		return false;
+	}
+
+	void clear() { m_held.clear(); }
+
+private:
+	std::unordered_map<ConflictKey, size_t> m_held; // key -> number of items holding it
+};
+
+// FIFO of PendingItems with conflict index kept in sync with its content.
+class CmdQueue {
+public:
+	using iterator = std::deque<PendingItem>::iterator;
+	using const_iterator = std::deque<PendingItem>::const_iterator;
+
+	template <typename... Args>
+	void emplace_back(Args &&... args) {
+		m_items.emplace_back(std::forward<Args>(args)...);
+		m_index.add(m_items.back().held);
+	}
+
+	void pop_front() {
+		m_index.remove(m_items.front().held);
+		m_items.pop_front();
+	}
+
+	iterator erase(iterator it) {
+		m_index.remove(it->held);
+		return m_items.erase(it);
+	}
+
+	PendingItem &front() { return m_items.front(); }
+	const PendingItem &front() const { return m_items.front(); }
+	PendingItem &back() { return m_items.back(); }
+	const PendingItem &back() const { return m_items.back(); }
+	bool empty() const { return m_items.empty(); }
+	size_t size() const { return m_items.size(); }
+
+	iterator begin() { return m_items.begin(); }
+	iterator end() { return m_items.end(); }
+	const_iterator begin() const { return m_items.begin(); }
+	const_iterator end() const { return m_items.end(); }
+
+	iterator find(uint64_t id) {
+		for (auto it = m_items.begin(); it != m_items.end(); ++it)
+			if (it->id == id)
+				return it;
+		return m_items.end();
+	}
+
+	bool conflict(const Cmd &cmd) const { return m_index.contains(cmd.conflictKeys()); }
+
+	// Returns the last queued item of the same type as 'cmd', which conflicts
+	// with 'cmd' (i.e. has the same target), iff no other conflicting item is
+	// queued after it. Replacing such item keeps order of conflicting commands.
+	PendingItem *lastSameTarget(const Cmd &cmd) {
+		if (!conflict(cmd))
+			return nullptr;
+		for (auto it = m_items.rbegin(); it != m_items.rend(); ++it)
+			if (cmd.conflict(*(it->cmd)))
+				return (it->cmd->type() == cmd.type()) ? &(*it) : nullptr;
+		return nullptr;
+	}
+
+	void replace(PendingItem &item, PendingItem &&by) {
+		m_index.remove(item.held);
+		item = std::move(by);
+		m_index.add(item.held);
+	}
+
+private:
+	std::deque<PendingItem> m_items;
+	ConflictIndex m_index;
+};
+
+// Min-heap of timeouts of pending items. Entries are invalidated lazily:
+// entry of an item, which is not pending anymore, is dropped once it gets
+// to the top.
+class DeadlineHeap {
+public:
+	struct Entry {
+		Timestamp deadline;
+		uint64_t id;
+
+		bool operator>(const Entry &other) const { return deadline > other.deadline; }
+	};
+
+	void push(Timestamp deadline, uint64_t id) { m_heap.push({deadline, id}); }
+	void pop() { m_heap.pop(); }
+	const Entry &top() const { return m_heap.top(); }
+	bool empty() const { return m_heap.empty(); }
+	size_t size() const { return m_heap.size(); }
+	void clear() { m_heap = decltype(m_heap)(); }
+
+private:
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> m_heap;
+};
+
+// Outgoing queue: one CmdQueue per CmdPriority.
+class OutQueue {
+public:
+	// Returns commands superseded by the pushed one: an emergency stop would
+	// otherwise overtake earlier speed commands (of its loco or all locos) in
+	// lower lanes. Track on/off conflicts with nothing in lower lanes.
+	std::vector<PendingItem> push(PendingItem &&item) {
+		std::vector<PendingItem> superseded;
+		const CmdPriority prio = priority(item.cmd->type());
+		if (prio == CmdPriority::Safety) {
+			for (size_t i = static_cast<size_t>(prio)+1; i < _CMD_PRIORITY_COUNT; i++) {
+				CmdQueue &lane = m_lanes[i];
+				if (!lane.conflict(*(item.cmd)))
+					continue;
+				for (auto it = lane.begin(); it != lane.end();) {
+					if (item.cmd->conflict(*(it->cmd))) {
+						superseded.emplace_back(std::move(*it));
+						it = lane.erase(it);
+					} else {
+						++it;
+					}
+				}
+			}
+		}
+		lane(prio).emplace_back(std::move(item));
+		return superseded;
+	}
+
+	// Next item to send; queue must not be empty.
+	const PendingItem &front() const { return m_lanes[nextLane()].front(); }
+
+	// Removes & returns the next item to send.
+	PendingItem take() {
+		const size_t next = nextLane();
+		if (m_lanes[_LOWEST].empty() || next == _LOWEST)
+			m_lowest_skipped = 0;
+		else
+			m_lowest_skipped++;
+
+		PendingItem item = std::move(m_lanes[next].front());
+		m_lanes[next].pop_front();
+		return item;
+	}
+
+	bool empty() const {
+		for (const CmdQueue &lane : m_lanes)
+			if (!lane.empty())
+				return false;
+		return true;
+	}
+
+	size_t size() const {
+		size_t size = 0;
+		for (const CmdQueue &lane : m_lanes)
+			size += lane.size();
+		return size;
+	}
+
+	size_t depth(CmdPriority prio) const { return m_lanes[static_cast<size_t>(prio)].size(); }
+
+	bool conflict(const Cmd &cmd) const {
+		for (const CmdQueue &lane : m_lanes)
+			if (lane.conflict(cmd))
+				return true;
+		return false;
+	}
+
+	PendingItem *lastSameTarget(const Cmd &cmd) {
+		return lane(priority(cmd.type())).lastSameTarget(cmd);
+	}
+
+	void replace(PendingItem &item, PendingItem &&by) {
+		lane(priority(by.cmd->type())).replace(item, std::move(by));
+	}
+
+private:
+	static constexpr size_t _LOWEST = _CMD_PRIORITY_COUNT-1;
+
+	std::array<CmdQueue, _CMD_PRIORITY_COUNT> m_lanes;
+	size_t m_lowest_skipped = 0;
+
+	CmdQueue &lane(CmdPriority prio) { return m_lanes[static_cast<size_t>(prio)]; }
+
+	size_t nextLane() const {
+		size_t next = _LOWEST;
+		for (size_t i = 0; i < _CMD_PRIORITY_COUNT; i++) {
+			if (!m_lanes[i].empty()) {
+				next = i;
+				break;
+			}
+		}
+		if (!m_lanes[_LOWEST].empty() && (m_lowest_skipped+1 >= _OUT_STARVATION_LIMIT))
+			next = _LOWEST;
+		return next;
+	}
+};
+
+} // namespace Xn
+
+#endif
@@ -6,64 +6,80 @@ namespace Xn {
 
 void XpressNet::handleReadyRead() {
 	// check timeout
-	if (m_receiveTimeout < QDateTime::currentDateTime() && m_readData.size() > 0) {
+	const Timestamp time = now();
+	if (m_receiveTimeout < time && !m_framer.empty()) {
 		// clear input buffer when data not received for a long time
-		m_readData.clear();
+		m_framer.clear();
+		m_framer.stats().timeouts++;
 	}
-
-	m_readData.append(m_serialPort.readAll());
-	m_receiveTimeout = QDateTime::currentDateTime().addMSecs(_BUF_IN_TIMEOUT);
-
-	if (this->m_liType == LIType::LIUSBEth) {
-		// remove message till 0xFF 0xFE or 0xFF 0xFD
-		int fe_pos = m_readData.indexOf(QByteArray("\xFF\xFE"));
-		int fd_pos = m_readData.indexOf(QByteArray("\xFF\xFD"));
-		if (fe_pos == -1)
-			fe_pos = m_readData.size();
-		if (fd_pos == -1)
-			fd_pos = m_readData.size();
-		m_readData.remove(0, std::min(fe_pos, fd_pos));
+	m_receiveTimeout = time + msToTimestamp(_BUF_IN_TIMEOUT);
+
+	if ((m_config.readBufferSize > 0) &&
+	    (m_transport->bytesAvailable() >= static_cast<qint64>(m_config.readBufferSize)))
+		m_framer.stats().overflows++;
+
+	while (m_transport->bytesAvailable() > 0) {
+		auto free = m_framer.writable();
+		const qint64 read = m_transport->read(free.first, free.second);
+		if (read <= 0)
+			break;
+		m_framer.commit(static_cast<size_t>(read));
+		bump(m_metrics.engine().bytesReceived, static_cast<uint64_t>(read));
+		if (m_trace.active())
+			m_trace.record(time, TraceDir::Rx, static_cast<uint8_t>(m_liType), free.first,
+			               static_cast<size_t>(read));
+		this->parseFrames();
 	}
+	m_metrics.receive().update(m_framer.stats());
+}
 
-	int length_pos = (this->m_liType == LIType::LIUSBEth ? 2 : 0);
+bool XpressNet::replayReceived(LIType liType, const uint8_t *data, size_t len) {
+	if (this->connected())
+		return false;
 
-	while (m_readData.size() > length_pos &&
-	       m_readData.size() >= (m_readData[length_pos] & 0x0F)+2+length_pos) {
-		unsigned int length = (m_readData[length_pos] & 0x0F)+2; // including header byte & xor
-		uint8_t x = 0;
-		for (unsigned int i = length_pos; i < length_pos+length; i++)
-			x ^= m_readData[i];
+	bump(m_metrics.engine().bytesReceived, len);
+	if (liType != m_liType) {
+		m_liType = liType;
+		m_framer.clear();
+		m_framer.setLiHeader(liType == LIType::LIUSBEth);
+	}
 
-		log("GET: " + dataToStr<QByteArray, uint8_t>(m_readData, length_pos+length),
-		    LogLevel::RawData);
+	while (len > 0) {
+		const size_t appended = m_framer.append(data, len);
+		data += appended;
+		len -= appended;
+		this->parseFrames();
+	}
+	m_metrics.receive().update(m_framer.stats());
+	return true;
+}
 
-		if (x != 0) {
-			// XOR error
-			log("XOR error: " + dataToStr<QByteArray, uint8_t>(m_readData, length_pos+length),
-			    LogLevel::Warning);
-			m_readData.remove(0, static_cast<int>(length_pos+length));
+void XpressNet::parseFrames() {
+	MsgType msg;
+	FrameResult result;
+	while ((result = m_framer.next(msg)) != FrameResult::NeedMore) {
+		if (result == FrameResult::XorError) {
+			// One warning per resync, skipped bytes are counted in ReceiveStats
+			if (!m_xorResync)
+				log(LogLevel::Warning, [&]() { return "XOR error: " + dataToStr<MsgType, uint8_t>(msg); });
+			m_xorResync = true;
 			continue;
 		}
+		m_xorResync = false;
 
-		auto begin = m_readData.begin();
-		for (int i = 0; i < length_pos; i++)
-			++begin;
-
-		std::vector<uint8_t> message(begin, begin + length);
+		log(LogLevel::RawData, [&]() { return "GET: " + dataToStr<MsgType, uint8_t>(msg); });
 
 		try {
-			parseMessage(message);
+			parseMessage(msg);
 		} catch (const QStrException& e) {
 			log("parseMessage exception: "+e.str(), LogLevel::Error);
 		} catch (...) {
 			log("parseMessage general exception!", LogLevel::Error);
 		}
-
-		m_readData.remove(0, static_cast<int>(length_pos+length));
 	}
 }
 
-void XpressNet::parseMessage(MsgType &msg) {
+void XpressNet::parseMessage(const MsgType &msg) {
 	switch (static_cast<RecvCmdType>(msg[0])) {
 	case RecvCmdType::LiError:
 		return handleMsgLiError(msg);
@@ -101,7 +117,7 @@ void XpressNet::parseMessage(MsgType &msg) {
 		return handleMsgAcc(msg);
 }
 
-void XpressNet::handleMsgLiError(MsgType &msg) {
+void XpressNet::handleMsgLiError(const MsgType &msg) {
 	if (0x01 == msg[1]) {
 		log("GET: Error occurred between the interfaces and the PC", LogLevel::Error);
 	} else if (0x02 == msg[1]) {
@@ -109,19 +125,25 @@ void XpressNet::handleMsgLiError(MsgType &msg) {
 	} else if (0x03 == msg[1]) {
 		log("GET: Unknown communication error", LogLevel::Error);
 	} else if (0x04 == msg[1]) {
-		log("GET: OK", LogLevel::Commands);
-
-		if (!m_pending.empty() && is<CmdReadDirect>(m_pending.front())) {
-			const auto &rd = dynamic_cast<const CmdReadDirect &>(*(m_pending.front().cmd));
-			to_send(CmdRequestReadResult(rd.cv, rd.callback), std::move(m_pending.front().callback_ok),
-			        std::move(m_pending.front().callback_err));
-		} else if (!m_pending.empty() && is<CmdWriteDirect>(m_pending.front())) {
-			const auto &wr = dynamic_cast<const CmdWriteDirect &>(*(m_pending.front().cmd));
-			to_send(CmdRequestWriteResult(wr.cv, wr.data), std::move(m_pending.front().callback_ok),
-			        std::move(m_pending.front().callback_err));
+		log(LogLevel::Commands, [&]() { return "GET: OK"; });
+
+		auto it = pending_find_if([](const PendingItem &item) { return item.cmd->okResponse(); });
+		if (it == m_pending.end())
+			return;
+
+		const uint64_t id = it->id;
+		if (is<CmdReadDirect>(*it)) {
+			const auto &rd = as<CmdReadDirect>(*(it->cmd));
+			to_send(CmdRequestReadResult(rd.cv, rd.callback), std::move(it->callback_ok),
+			        std::move(it->callback_err));
+		} else if (is<CmdWriteDirect>(*it)) {
+			const auto &wr = as<CmdWriteDirect>(*(it->cmd));
+			to_send(CmdRequestWriteResult(wr.cv, wr.data), std::move(it->callback_ok),
+			        std::move(it->callback_err));
 		}
-		if (!m_pending.empty() && m_pending.front().cmd->okResponse())
-			pending_ok();
+		it = m_pending.find(id); // to_send could invalidate iterators
+		if (it != m_pending.end())
+			pending_ok(it);
 	} else if (0x05 == msg[1]) {
 		log("GET: ERR: The Command Station is no longer providing the LI "
 		    "a timeslot for communication",
@@ -143,23 +165,28 @@ void XpressNet::handleMsgLiError(MsgType &msg) {
 	}
 }
 
-void XpressNet::handleMsgLiVersion(MsgType &msg) {
+void XpressNet::handleMsgLiVersion(const MsgType &msg) {
 	const uint8_t hw = msg[1];
 	const uint8_t sw = msg[2];
 
-	log("GET: LI version; HW: " + XpressNet::liVersionToStr(hw) + ", SW: " + XpressNet::liVersionToStr(sw),
-	    LogLevel::Commands);
+	log(LogLevel::Commands, [&]() {
+		return "GET: LI version; HW: " + XpressNet::liVersionToStr(hw) + ", SW: " +
+		       XpressNet::liVersionToStr(sw);
+	});
 	this->checkLiVersionDeprecated(hw, sw);
 
-	if (!m_pending.empty() && is<CmdGetLIVersion>(m_pending.front())) {
-		std::unique_ptr<const Cmd> cmd = std::move(m_pending.front().cmd);
-		pending_ok();
-		const auto &pending = dynamic_cast<const CmdGetLIVersion &>(*cmd);
+	auto it = pending_find<CmdGetLIVersion>();
+	if (it != m_pending.end()) {
+		std::unique_ptr<const Cmd> cmd = std::move(it->cmd);
+		pending_ok(it);
+		const auto &pending = as<CmdGetLIVersion>(*cmd);
 		if (pending.callback != nullptr)
 			pending.callback(this, hw, sw);
-	} else if (!m_pending.empty() && is<CmdGetLIAddress>(m_pending.front())) {
+	} else {
 		// Report NanoX error faster
-		pending_err();
+		it = pending_find<CmdGetLIAddress>();
+		if (it != m_pending.end())
+			pending_err(it);
 	}
 }
 
@@ -173,25 +200,27 @@ void XpressNet::checkLiVersionDeprecated(uint8_t hw, uint8_t sw)
 		    LogLevel::Warning);
 }
 
-void XpressNet::handleMsgCsGeneralEvent(MsgType &msg) {
+void XpressNet::handleMsgCsGeneralEvent(const MsgType &msg) {
 	if (0x00 == msg[1]) {
-		log("GET: Status Off", LogLevel::Commands);
-		if (!m_pending.empty() && is<CmdOff>(m_pending.front()))
-			pending_ok();
+		log(LogLevel::Commands, [&]() { return "GET: Status Off"; });
+		auto it = pending_find<CmdOff>();
+		if (it != m_pending.end())
+			pending_ok(it);
 		if (m_trk_status != TrkStatus::Off) {
 			m_trk_status = TrkStatus::Off;
 			emit onTrkStatusChanged(m_trk_status);
 		}
 	} else if (0x01 == msg[1]) {
-		log("GET: Status On", LogLevel::Commands);
-		if (!m_pending.empty() && is<CmdOn>(m_pending.front()))
-			pending_ok();
+		log(LogLevel::Commands, [&]() { return "GET: Status On"; });
+		auto it = pending_find<CmdOn>();
+		if (it != m_pending.end())
+			pending_ok(it);
 		if (m_trk_status != TrkStatus::On) {
 			m_trk_status = TrkStatus::On;
 			emit onTrkStatusChanged(m_trk_status);
 		}
 	} else if (0x02 == msg[1]) {
-		log("GET: Status Programming", LogLevel::Commands);
+		log(LogLevel::Commands, [&]() { return "GET: Status Programming"; });
 		if (m_trk_status != TrkStatus::Programming) {
 			m_trk_status = TrkStatus::Programming;
 			emit onTrkStatusChanged(m_trk_status);
@@ -201,20 +230,31 @@ void XpressNet::handleMsgCsGeneralEvent(MsgType &msg) {
 		const QString message = xnReadCVStatusToQString(static_cast<ReadCVStatus>(msg[1]));
 		log("GET: Programming info: "+message, ok ? LogLevel::Info : LogLevel::Error);
 
-		if (!m_pending.empty()) {
-			if (is<CmdRequestReadResult>(m_pending.front())) {
-				std::unique_ptr<const Cmd> cmd = std::move(m_pending.front().cmd);
-				pending_ok();
-				const CmdRequestReadResult *cmdrrr = dynamic_cast<const CmdRequestReadResult *>(cmd.get());
-				cmdrrr->callback(this, static_cast<ReadCVStatus>(msg[1]), cmdrrr->cv, 0);
-			} else if (is<CmdReadDirect>(m_pending.front())) {
-				std::unique_ptr<const Cmd> cmd = std::move(m_pending.front().cmd);
-				pending_ok();
-				const CmdReadDirect *cmdrd = dynamic_cast<const CmdReadDirect*>(cmd.get());
-				cmdrd->callback(this, static_cast<ReadCVStatus>(msg[1]), cmdrd->cv, 0);
-			} else if ((!ok) && ((is<CmdRequestWriteResult>(m_pending.front())) || (is<CmdWriteDirect>(m_pending.front())))) {
+		auto it = pending_find_if([](const PendingItem &item) { return isProgramming(item.cmd->type()); });
+		if (it != m_pending.end()) {
+			switch (it->cmd->type()) {
+			case CmdType::RequestReadResult: {
+				std::unique_ptr<const Cmd> cmd = std::move(it->cmd);
+				pending_ok(it);
+				const auto &cmdrrr = as<CmdRequestReadResult>(*cmd);
+				cmdrrr.callback(this, static_cast<ReadCVStatus>(msg[1]), cmdrrr.cv, 0);
+				break;
+			}
+			case CmdType::ReadDirect: {
+				std::unique_ptr<const Cmd> cmd = std::move(it->cmd);
+				pending_ok(it);
+				const auto &cmdrd = as<CmdReadDirect>(*cmd);
+				cmdrd.callback(this, static_cast<ReadCVStatus>(msg[1]), cmdrd.cv, 0);
+				break;
+			}
+			case CmdType::RequestWriteResult:
+			case CmdType::WriteDirect:
 				// Error in writing is reported as pending_error
-				pending_err(false);
+				if (!ok)
+					pending_err(it, false);
+				break;
+			default:
+				break;
 			}
 		}
 	} else if (0x80 == msg[1]) {
@@ -226,8 +266,8 @@ void XpressNet::handleMsgCsGeneralEvent(MsgType &msg) {
 	}
 }
 
-void XpressNet::handleMsgCsStatus(MsgType &msg) {
-	log("GET: command station status", LogLevel::Commands);
+void XpressNet::handleMsgCsStatus(const MsgType &msg) {
+	log(LogLevel::Commands, [&]() { return "GET: command station status"; });
 	TrkStatus n;
 	if (msg[2] & 0x03)
 		n = TrkStatus::Off;
@@ -236,8 +276,9 @@ void XpressNet::handleMsgCsStatus(MsgType &msg) {
 	else
 		n = TrkStatus::On;
 
-	if (!m_pending.empty() && is<CmdGetCSStatus>(m_pending.front()))
-		pending_ok();
+	auto it = pending_find<CmdGetCSStatus>();
+	if (it != m_pending.end())
+		pending_ok(it);
 
 	if (n != m_trk_status) {
 		m_trk_status = n;
@@ -245,71 +286,82 @@ void XpressNet::handleMsgCsStatus(MsgType &msg) {
 	}
 }
 
-void XpressNet::handleMsgCsVersion(MsgType &msg) {
+void XpressNet::handleMsgCsVersion(const MsgType &msg) {
 	const unsigned major = msg[2] >> 4;
 	const unsigned minor =  msg[2] & 0x0F;
 	const uint8_t id = msg[3];
 
-	log("GET: Command Station Version " + QString::number(major) + "." +
-		QString::number(minor) + ", id " + QString::number(id), LogLevel::Commands);
-
-	if (!m_pending.empty() && is<CmdGetCSVersion>(m_pending.front())) {
-		std::unique_ptr<const Cmd> cmd = std::move(m_pending.front().cmd);
-		pending_ok();
-		if (dynamic_cast<const CmdGetCSVersion *>(cmd.get())->callback != nullptr) {
-			dynamic_cast<const CmdGetCSVersion *>(cmd.get())->callback(
-				this, major, minor, id
-			);
-		}
+	log(LogLevel::Commands, [&]() {
+		return "GET: Command Station Version " + QString::number(major) + "." +
+		       QString::number(minor) + ", id " + QString::number(id);
+	});
+
+	auto it = pending_find<CmdGetCSVersion>();
+	if (it != m_pending.end()) {
+		std::unique_ptr<const Cmd> cmd = std::move(it->cmd);
+		pending_ok(it);
+		const auto &cmdcsv = as<CmdGetCSVersion>(*cmd);
+		if (cmdcsv.callback != nullptr)
+			cmdcsv.callback(this, major, minor, id);
 	}
 }
 
-void XpressNet::handleMsgCvRead(MsgType &msg) {
+void XpressNet::handleMsgCvRead(const MsgType &msg) {
 	uint8_t cv = msg[2];
 	uint8_t value = msg[3];
 
-	log("GET: CV " + QString::number(cv) + " value=" + QString::number(value),
-	    LogLevel::Commands);
+	log(LogLevel::Commands, [&]() {
+		return "GET: CV " + QString::number(cv) + " value=" + QString::number(value);
+	});
 
-	if (m_pending.empty())
+	auto it = pending_find_if([](const PendingItem &item) { return isProgramming(item.cmd->type()); });
+	if (it == m_pending.end())
 		return;
 
-	if (is<CmdRequestReadResult>(m_pending.front())) {
-		std::unique_ptr<const Cmd> cmd = std::move(m_pending.front().cmd);
-		pending_ok();
-		dynamic_cast<const CmdRequestReadResult *>(cmd.get())->callback(
-			this, ReadCVStatus::Ok, cv, value
-		);
-	} else if (is<CmdReadDirect>(m_pending.front())) {
-		std::unique_ptr<const Cmd> cmd = std::move(m_pending.front().cmd);
-		const CmdReadDirect *cmdrd = dynamic_cast<const CmdReadDirect *>(cmd.get());
-		if (cv == cmdrd->cv) {
-			pending_ok();
-			cmdrd->callback(this, ReadCVStatus::Ok, cv, value);
+	switch (it->cmd->type()) {
+	case CmdType::RequestReadResult: {
+		std::unique_ptr<const Cmd> cmd = std::move(it->cmd);
+		pending_ok(it);
+		as<CmdRequestReadResult>(*cmd).callback(this, ReadCVStatus::Ok, cv, value);
+		break;
+	}
+	case CmdType::ReadDirect: {
+		const auto &cmdrd = as<CmdReadDirect>(*(it->cmd));
+		if (cv == cmdrd.cv) {
+			std::unique_ptr<const Cmd> cmd = std::move(it->cmd);
+			pending_ok(it);
+			as<CmdReadDirect>(*cmd).callback(this, ReadCVStatus::Ok, cv, value);
 		}
-	} else if (is<CmdRequestWriteResult>(m_pending.front())) {
-		std::unique_ptr<const Cmd> cmd = std::move(m_pending.front().cmd);
-		if (value == dynamic_cast<const CmdRequestWriteResult *>(cmd.get())->value) {
-			pending_ok();
+		break;
+	}
+	case CmdType::RequestWriteResult:
+		if (value == as<CmdRequestWriteResult>(*(it->cmd)).value) {
+			pending_ok(it);
 		} else {
 			// Mismatch in written & read CV values is reported as pending_err
 			log("GET: Received value "+QString::number(value)+" does not match programmed value!", LogLevel::Error);
-			pending_err(false);
+			pending_err(it, false);
 		}
-	} else if (is<CmdWriteDirect>(m_pending.front())) {
-		std::unique_ptr<const Cmd> cmd = std::move(m_pending.front().cmd);
-		if (value == dynamic_cast<const CmdWriteDirect *>(cmd.get())->data)
-			pending_ok();
+		break;
+	case CmdType::WriteDirect:
+		if (value == as<CmdWriteDirect>(*(it->cmd)).data)
+			pending_ok(it);
 		// else mismatch -> ask for CV value again (send CmdRequestWriteResult)
+		break;
+	default:
+		break;
 	}
 }
 
-void XpressNet::handleMsgLocoInfo(MsgType &msg) {
-	log("GET: loco information", LogLevel::Commands);
+void XpressNet::handleMsgLocoInfo(const MsgType &msg) {
+	log(LogLevel::Commands, [&]() { return "GET: loco information"; });
 
-	if (!m_pending.empty() && is<CmdGetLocoInfo>(m_pending.front())) {
-		std::unique_ptr<const Cmd> cmd = std::move(m_pending.front().cmd);
-		pending_ok();
+	// Response does not contain loco address -> the only pending request is
+	// answered (see isLocoQuery)
+	auto it = pending_find<CmdGetLocoInfo>();
+	if (it != m_pending.end()) {
+		std::unique_ptr<const Cmd> cmd = std::move(it->cmd);
+		pending_ok(it);
 
 		bool used = (msg[1] >> 3) & 0x01;
 		unsigned mode = msg[1] & 0x07;
@@ -346,52 +398,56 @@ void XpressNet::handleMsgLocoInfo(MsgType &msg) {
 			speed = speed * (28./128);
 		}
 
-		if (dynamic_cast<const CmdGetLocoInfo *>(cmd.get())->callback != nullptr) {
-			dynamic_cast<const CmdGetLocoInfo *>(cmd.get())->callback(
-			    this, used, direction, speed, FA(msg[3]), FB(msg[4]));
-		}
+		const auto &cmdli = as<CmdGetLocoInfo>(*cmd);
+		m_locos.info(cmdli.loco, used, direction, speed, FA(msg[3]), FB(msg[4]), now());
+		if (cmdli.callback != nullptr)
+			cmdli.callback(this, used, direction, speed, FA(msg[3]), FB(msg[4]));
 	}
 }
 
-void XpressNet::handleMsgLocoFunc(MsgType &msg) {
+void XpressNet::handleMsgLocoFunc(const MsgType &msg) {
 	if (msg[1] == 0x40) {
 		try {
 			LocoAddr addr(msg[3], msg[2]);
-			log("GET: Loco "+QString(addr)+" stolen", LogLevel::Commands);
+			log(LogLevel::Commands, [&]() { return "GET: Loco "+QString(addr)+" stolen"; });
+			m_locos.invalidate(addr);
 			emit this->onLocoStolen(addr);
 		} catch (...) {
 
 		}
 	} else if (msg[1] == 0x52) {
-		log("GET: Loco Func 13-28 Status", LogLevel::Commands);
+		log(LogLevel::Commands, [&]() { return "GET: Loco Func 13-28 Status"; });
 
-		if (!m_pending.empty() && is<CmdGetLocoFunc1328>(m_pending.front())) {
-			std::unique_ptr<const Cmd> cmd = std::move(m_pending.front().cmd);
-			pending_ok();
+		auto it = pending_find<CmdGetLocoFunc1328>(); // the only one, see isLocoQuery
+		if (it != m_pending.end()) {
+			std::unique_ptr<const Cmd> cmd = std::move(it->cmd);
+			pending_ok(it);
 
-			if (dynamic_cast<const CmdGetLocoFunc1328 *>(cmd.get())->callback != nullptr) {
-				dynamic_cast<const CmdGetLocoFunc1328 *>(cmd.get())->callback(
-					this, FC(msg[2]), FD(msg[3])
-				);
-			}
+			const auto &cmdlf = as<CmdGetLocoFunc1328>(*cmd);
+			m_locos.func1328(cmdlf.loco, FC(msg[2]), FD(msg[3]), now());
+			if (cmdlf.callback != nullptr)
+				cmdlf.callback(this, FC(msg[2]), FD(msg[3]));
 		}
 	}
 }
 
-void XpressNet::handleMsgLIAddr(MsgType &msg) {
-	log("GET: LI Address is " + QString::number(msg[2]), LogLevel::Commands);
-	if (!m_pending.empty() && is<CmdGetLIAddress>(m_pending.front())) {
-		std::unique_ptr<const Cmd> cmd = std::move(m_pending.front().cmd);
-		pending_ok();
-		if (dynamic_cast<const CmdGetLIAddress *>(cmd.get())->callback != nullptr) {
-			dynamic_cast<const CmdGetLIAddress *>(cmd.get())->callback(this, msg[2]);
-		}
-	} else if (!m_pending.empty() && is<CmdSetLIAddress>(m_pending.front())) {
-		pending_ok();
+void XpressNet::handleMsgLIAddr(const MsgType &msg) {
+	log(LogLevel::Commands, [&]() { return "GET: LI Address is " + QString::number(msg[2]); });
+	auto it = pending_find<CmdGetLIAddress>();
+	if (it != m_pending.end()) {
+		std::unique_ptr<const Cmd> cmd = std::move(it->cmd);
+		pending_ok(it);
+		const auto &cmdla = as<CmdGetLIAddress>(*cmd);
+		if (cmdla.callback != nullptr)
+			cmdla.callback(this, msg[2]);
+	} else {
+		it = pending_find<CmdSetLIAddress>();
+		if (it != m_pending.end())
+			pending_ok(it);
 	}
 }
 
-void XpressNet::handleMsgAcc(MsgType &msg) {
+void XpressNet::handleMsgAcc(const MsgType &msg) {
 	const uint8_t bytes = (msg[0] & 0x0F);
 	if ((bytes%2) != 0) {
 		log("GET: Invalid Feedback Broadcast length (not even), ignoring packet!", LogLevel::Warning);
@@ -409,29 +465,59 @@ void XpressNet::handleMsgAcc(MsgType &msg) {
 		auto inputType = static_cast<FeedbackType>((msg[2+i] >> 5) & 0x3);
 		AccInputsState state;
 		state.all = msg[2+i] & 0x0F;
+		const bool changed = (m_feedback.update(groupAddr, msg[2+i]) != 0);
 
-		log("GET: Acc state: group " + QString::number(groupAddr) + ", nibble " +
-		    QString::number(nibble) + ", state " + QString::number(state.all, 2).rightJustified(4, '0'),
-		    LogLevel::Commands);
-		if ((!m_pending.empty()) && (is<CmdAccInfoRequest>(m_pending.front())) &&
-		    (dynamic_cast<const CmdAccInfoRequest *>(m_pending.front().cmd.get())->groupAddr == groupAddr) &&
-		    (dynamic_cast<const CmdAccInfoRequest *>(m_pending.front().cmd.get())->nibble == nibble))
-			pending_ok();
+		auto info = pending_find<CmdAccInfoRequest>([groupAddr, nibble](const CmdAccInfoRequest &cmd) {
+			return (cmd.groupAddr == groupAddr) && (cmd.nibble == nibble);
+		});
+		const bool requested = (info != m_pending.end());
+		if (requested)
+			pending_ok(info);
 
 		// Some command stations (with internal output->input feedback enabled)
 		// send Acc feedback directly after AccOpRequest. The LI does not receive any
 		// normal inquiry, thus it does not send expected "OK" response.
 		// -> Check for this situation & call pending_ok on pending CmdAccOpRequest
-		if ((!m_pending.empty()) && (is<CmdAccOpRequest>(m_pending.front()))) {
-			const auto& accOpCmd = dynamic_cast<const CmdAccOpRequest *>(m_pending.front().cmd.get());
-			unsigned int port = 8*groupAddr + 4*nibble + (accOpCmd->portAddr & 0x03);
-			bool bstate = ((state.all & (1 << (accOpCmd->portAddr & 0x03))) > 0);
-			if ((accOpCmd->portAddr == port) && (accOpCmd->state == bstate))
-				pending_ok();
-		}
+		auto op = pending_find<CmdAccOpRequest>([groupAddr, nibble, state](const CmdAccOpRequest &cmd) {
+			unsigned int port = 8*groupAddr + 4*nibble + (cmd.portAddr & 0x03);
+			bool bstate = ((state.all & (1 << (cmd.portAddr & 0x03))) > 0);
+			return (cmd.portAddr == port) && (cmd.state == bstate);
+		});
+		if (op != m_pending.end())
+			pending_ok(op);
+
+		// Command stations repeat broadcasts, only changes are reported
+		if ((!changed) && (!requested))
+			continue;
 
+		log(LogLevel::Commands, [&]() {
+			return "GET: Acc state: group " + QString::number(groupAddr) + ", nibble " +
+			       QString::number(nibble) + ", state " +
+			       QString::number(state.all, 2).rightJustified(4, '0');
+		});
 		emit onAccInputChanged(groupAddr, nibble, error, inputType, state);
+		m_feedback_changes.push_back({groupAddr, nibble, error, inputType, state});
 	}
+
+	if (m_feedback_changes.empty())
+		return;
+	if (m_config.feedbackWindow == 0)
+		this->feedback_flush();
+	else if (!m_feedback_timer.isActive())
+		m_feedback_timer.start(static_cast<int>(m_config.feedbackWindow));
+}
+
+void XpressNet::feedback_flush() {
+	m_feedback_timer.stop();
+	if (m_feedback_changes.empty())
+		return;
+	AccInputChanges changes;
+	changes.swap(m_feedback_changes);
+	emit onAccInputsChanged(changes);
+}
+
+void XpressNet::m_feedback_timer_tick() {
+	this->feedback_flush();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -4,38 +4,38 @@
 
 namespace Xn {
 
-void XpressNet::send(MsgType data) {
-	uint8_t x = 0;
-	for (uint8_t d : data)
-		x ^= d;
-	data.push_back(x);
-
-	if (this->m_liType == LIType::LIUSBEth) {
-		data.emplace(data.begin(), 0xFE);
-		data.emplace(data.begin(), 0xFF);
-	}
+void XpressNet::send(Frame data) {
+	data.seal(this->m_liType == LIType::LIUSBEth);
 
-	log("PUT: " + dataToStr<MsgType, uint8_t>(data), LogLevel::RawData);
-	QByteArray qdata(reinterpret_cast<const char *>(data.data()), data.size());
+	log(LogLevel::RawData, [&]() { return "PUT: " + dataToStr<Frame, uint8_t>(data); });
+	m_pacer.sent(data.size(), now());
+	if (m_trace.active())
+		m_trace.record(now(), TraceDir::Tx, static_cast<uint8_t>(m_liType), data.data(), data.size());
 
-	qint64 sent = m_serialPort.write(qdata);
-	if (sent == -1 || sent != qdata.size())
+	qint64 sent = this->connected() ? m_transport->write(data.data(), data.size()) : -1;
+	if (sent == -1 || sent != static_cast<qint64>(data.size()))
 		throw EWriteError("No data could we written!");
+	bump(m_metrics.engine().framesSent);
+	bump(m_metrics.engine().bytesSent, data.size());
 }
 
-void XpressNet::send(std::unique_ptr<const Cmd> cmd, UPCb ok, UPCb err, size_t no_sent) {
-	log("PUT: " + cmd->msg(), LogLevel::Commands);
+void XpressNet::send(std::unique_ptr<const Cmd> cmd, UPCb ok, UPCb err, size_t no_sent,
+                     UPCb superseded) {
+	log(LogLevel::Commands, [&]() { return "PUT: " + cmd->msg(); });
 
 	try {
-		m_lastSent = QDateTime::currentDateTime();
+		m_lastSent = now();
 		send(cmd->getBytes());
+		bump((no_sent == 1) ? m_metrics.cmd(cmd->type()).sent
+		                    : m_metrics.cmd(cmd->type()).retransmissions);
 		if (Xn::is<CmdAccOpRequest>(*cmd) && !this->liAcknowledgesSetAccState() &&
-		    dynamic_cast<const CmdAccOpRequest &>(*cmd).state) {
+		    as<CmdAccOpRequest>(*cmd).state) {
 			// acknowledge manually, do not add to pending buffer
 			if (nullptr != ok)
 				ok->func(this, ok->data);
-		} else
-			m_pending.emplace_back(cmd, timeout(cmd.get()), no_sent, std::move(ok), std::move(err));
+		} else {
+			pending_push(cmd, no_sent, std::move(ok), std::move(err), std::move(superseded));
+		}
 	} catch (QStrException &) {
 		log("Fatal error when writing command: " + cmd->msg(), LogLevel::Error);
 		if (nullptr != err)
@@ -44,24 +44,36 @@ void XpressNet::send(std::unique_ptr<const Cmd> cmd, UPCb ok, UPCb err, size_t n
 }
 
 void XpressNet::to_send(std::unique_ptr<const Cmd> &cmd, UPCb ok, UPCb err, size_t no_sent,
-                        bool bypass_m_out_emptiness) {
+                        bool bypass_m_out_emptiness, UPCb superseded) {
 	// Sends or queues
-	if ((m_pending.size() >= _PENDING_MAX_AT_ONCE) || (!m_out.empty() && !bypass_m_out_emptiness) ||
-	    conflictWithPending(*cmd)) {
+	if ((no_sent == 1) && (!bypass_m_out_emptiness) &&
+	    coalesce(cmd, ok, err, superseded))
+		return;
+
+	const bool wait = (m_pending.size() >= pendingWindow()) ||
+	                  (!m_out.empty() && !bypass_m_out_emptiness);
+	if (wait || conflictWithPending(*cmd)) {
 		// Pending full -> push & do not start timer (response from CS will send the next command from m_out)
 		// We ensure pending buffer never contains commands with conflict
-		log("ENQUEUE: " + cmd->msg(), LogLevel::Debug);
-		m_out.emplace_back(cmd, timeout(cmd.get()), no_sent, std::move(ok), std::move(err));
+		if (!wait)
+			bump(m_metrics.cmd(cmd->type()).conflictDeferrals);
+		log(LogLevel::Debug, [&]() { return "ENQUEUE: " + cmd->msg(); });
+		out_push(PendingItem(cmd, timeout(cmd.get()), no_sent, std::move(ok), std::move(err),
+		                     std::move(superseded)));
 	} else {
-		if (m_lastSent.addMSecs(m_config.outInterval) > QDateTime::currentDateTime()) {
+		const size_t delay = sendDelay(*cmd);
+		if (delay > 0) {
 			// Last command sent too early, still space in pending buffer ->
-			// queue & activate timer for next send
-			log("ENQUEUE: " + cmd->msg(), LogLevel::Debug);
-			m_out.emplace_back(cmd, timeout(cmd.get()), no_sent, std::move(ok), std::move(err));
-			if ((m_pending.empty()) && (!m_out_timer.isActive()))
-				m_out_timer.start();
+			// queue & activate timer for next send (do not wait for a response)
+			log(LogLevel::Debug, [&]() { return "ENQUEUE: " + cmd->msg(); });
+			out_push(PendingItem(cmd, timeout(cmd.get()), no_sent, std::move(ok), std::move(err),
+			                     std::move(superseded)));
+			if (!m_out_timer.isActive())
+				out_timer_start(delay);
 		} else {
-			send(std::move(cmd), std::move(ok), std::move(err), no_sent);
+			if ((no_sent == 1) && (!bypass_m_out_emptiness))
+				m_metrics.cmd(cmd->type()).queued.record(0); // not queued at all
+			send(std::move(cmd), std::move(ok), std::move(err), no_sent, std::move(superseded));
 		}
 	}
 }
@@ -70,39 +82,128 @@ void XpressNet::to_send(PendingItem &&pending, bool bypass_m_out_emptiness) {
 	// Pending resending uses m_out queue (could try to resend multiple messages once)
 	std::unique_ptr<const Cmd> cmd2(std::move(pending.cmd));
 	to_send(cmd2, std::move(pending.callback_ok), std::move(pending.callback_err), pending.no_sent + 1,
-	        bypass_m_out_emptiness);
+	        bypass_m_out_emptiness, std::move(pending.callback_superseded));
+}
+
+bool XpressNet::coalesce(std::unique_ptr<const Cmd> &cmd, UPCb &ok, UPCb &err, UPCb &superseded) {
+	// Replaces not-yet-sent command for the same loco & function group in m_out
+	if (!m_config.coalesce)
+		return false;
+
+	switch (cmd->type()) {
+	case CmdType::SetSpeedDir:
+	case CmdType::SetFuncA:
+	case CmdType::SetFuncB:
+	case CmdType::SetFuncC:
+	case CmdType::SetFuncD:
+		break;
+	default:
+		return false;
+	}
+
+	PendingItem *queued = m_out.lastSameTarget(*cmd);
+	if (nullptr == queued)
+		return false;
+
+	log(LogLevel::Debug, [&]() { return "COALESCE: " + queued->cmd->msg() + " -> " + cmd->msg(); });
+	PendingItem old(std::move(*queued));
+	PendingItem item(cmd, timeout(cmd.get()), 1, std::move(ok), std::move(err), std::move(superseded));
+	item.queued = now();
+	m_out.replace(*queued, std::move(item));
+	call_superseded(old);
+	return true;
+}
+
+void XpressNet::out_push(PendingItem &&item) {
+	item.queued = now();
+	std::vector<PendingItem> superseded = m_out.push(std::move(item));
+	for (PendingItem &s : superseded) {
+		log(LogLevel::Debug, [&]() { return "SUPERSEDED: " + s.cmd->msg(); });
+		call_dropped(s);
+	}
+	this->metrics_gauges();
+}
+
+void XpressNet::call_superseded(PendingItem &item) {
+	if (nullptr != item.callback_superseded)
+		item.callback_superseded->func(this, item.callback_superseded->data);
+	else if (nullptr != item.callback_ok)
+		item.callback_ok->func(this, item.callback_ok->data);
+}
+
+void XpressNet::call_dropped(PendingItem &item) {
+	// Not sent because of emergency stop: the command did not take effect
+	if (nullptr != item.callback_superseded)
+		item.callback_superseded->func(this, item.callback_superseded->data);
+	else if (nullptr != item.callback_err)
+		item.callback_err->func(this, item.callback_err->data);
 }
 
 void XpressNet::m_out_timer_tick() {
 	if (m_out.empty()) {
 		m_out_timer.stop();
 	} else {
-		if (m_pending.empty())
+		if (m_pending.size() < pendingWindow())
 			send_next_out();
 	}
 }
 
 void XpressNet::send_next_out() {
-	if (m_lastSent.addMSecs(m_config.outInterval) > QDateTime::currentDateTime()) {
-		if (!m_out_timer.isActive())
-			m_out_timer.start();
-		return;
+	// Sends queued commands while there is room in the pending window. Stops
+	// at a command conflicting with a pending one (its response sends it).
+	while ((!m_out.empty()) && (m_pending.size() < pendingWindow()) && (this->connected())) {
+		const PendingItem &front = m_out.front();
+		if (conflictWithPending(*(front.cmd)))
+			return;
+
+		const size_t delay = sendDelay(*(front.cmd));
+		if (delay > 0) {
+			if (!m_out_timer.isActive())
+				out_timer_start(delay);
+			return;
+		}
+
+		PendingItem out = m_out.take();
+		log(LogLevel::Debug, [&]() { return "DEQUEUE: " + out.cmd->msg(); });
+		if (out.no_sent == 1)
+			m_metrics.cmd(out.type).queued.record(static_cast<uint64_t>(now() - out.queued));
+		this->metrics_gauges();
+		// Not a retransmission -> keep no_sent
+		std::unique_ptr<const Cmd> cmd(std::move(out.cmd));
+		to_send(cmd, std::move(out.callback_ok), std::move(out.callback_err), out.no_sent, true,
+		        std::move(out.callback_superseded));
 	}
+}
+
+size_t XpressNet::sendDelay(const Cmd &cmd) {
+	// Returns time [ms] to wait before 'cmd' could be sent, 0 iff it could be sent now
+	if (m_config.pacing == PacingMode::Adaptive) {
+		const Timestamp delay = m_pacer.delay(wireBytes(cmd), now());
+		return static_cast<size_t>((delay + 999) / 1000);
+	}
+
+	const Timestamp wait = m_lastSent + msToTimestamp(m_config.outInterval) - now();
+	return (wait > 0) ? static_cast<size_t>((wait + 999) / 1000) : 0;
+}
+
+void XpressNet::out_timer_start(size_t delay) {
+	// Adaptive pacing: single shot after the pacer's delay, the next tick is
+	// planned by send_next_out (start(delay) of periodic timer would keep the
+	// short interval). Fixed pacing: periodic timer with outInterval.
+	const bool adaptive = (m_config.pacing == PacingMode::Adaptive);
+	m_out_timer.setSingleShot(adaptive);
+	m_out_timer.start(static_cast<int>(adaptive ? delay : m_config.outInterval));
+}
 
-	PendingItem out = std::move(m_out.front());
-	log("DEQUEUE: " + out.cmd->msg(), LogLevel::Debug);
-	m_out.pop_front();
-	to_send(std::move(out), true);
+size_t XpressNet::wireBytes(const Cmd &cmd) const {
+	// data + xor (+ LI-USB-Ethernet header)
+	return cmd.getBytes().size() + 1 + ((m_liType == LIType::LIUSBEth) ? 2 : 0);
 }
 
-QDateTime XpressNet::timeout(const Cmd *x) {
-	QDateTime timeout;
-	if (Xn::is<CmdReadDirect>(*x) || Xn::is<CmdWriteDirect>(*x) ||
-			Xn::is<CmdRequestReadResult>(*x) || Xn::is<CmdRequestWriteResult>(*x))
-		timeout = QDateTime::currentDateTime().addMSecs(_PENDING_PROG_TIMEOUT);
-	else
-		timeout = QDateTime::currentDateTime().addMSecs(_PENDING_TIMEOUT);
-	return timeout;
+Timestamp XpressNet::timeout(const Cmd *x) const {
+	if (isProgramming(x->type()))
+		return now() + msToTimestamp(_PENDING_PROG_TIMEOUT);
+	return now() + msToTimestamp(_PENDING_TIMEOUT);
 }
 
 } // namespace Xn
@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <iterator>
+
+#include "xn-trace.h"
+#include "xn.h"
+
+/* Binary trace of XpressNET communication: recording & replay. */
+
+namespace Xn {
+
+static const char _TRACE_MAGIC[4] = {'X', 'N', 'T', 'R'};
+
+///////////////////////////////////////////////////////////////////////////////
+
+TraceRecorder::TraceRecorder() {
+	m_buf.reserve(_TRACE_BUFFER_SIZE);
+}
+
+TraceRecorder::~TraceRecorder() {
+	try {
+		this->close();
+	} catch (...) {
+		// No exceptions in destructor
+	}
+}
+
+void TraceRecorder::open(const QString &filename) {
+	this->close();
+	m_file.setFileName(filename);
+	if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append))
+		throw ETraceError("Unable to open trace file "+filename+": "+m_file.errorString());
+
+	// Buffers are allocated here, not on the hot path
+	while (m_free.size() < _TRACE_BUFFERS-1) {
+		m_free.emplace_back();
+		m_free.back().reserve(_TRACE_BUFFER_SIZE);
+	}
+	m_buf.clear();
+	m_records = 0;
+	m_dropped = 0;
+	if (m_file.size() == 0) {
+		m_buf.insert(m_buf.end(), std::begin(_TRACE_MAGIC), std::end(_TRACE_MAGIC));
+		put<uint16_t>(_TRACE_VERSION);
+		put<uint16_t>(0);
+	}
+
+	m_stop = false;
+	m_active = true;
+	m_writer = std::thread(&TraceRecorder::writerLoop, this);
+	this->flush();
+}
+
+void TraceRecorder::close() {
+	if (!m_active)
+		return;
+	this->flush();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_cond.notify_one();
+	m_writer.join();
+	m_active = false;
+	m_file.close();
+}
+
+void TraceRecorder::record(Timestamp time, TraceDir dir, uint8_t liType, const uint8_t *data,
+                           size_t len) {
+	if (!m_active)
+		return;
+	len = std::min<size_t>(len, UINT16_MAX);
+	if (m_buf.size() + _TRACE_RECORD_HEADER_SIZE + len > _TRACE_BUFFER_SIZE)
+		this->flush();
+
+	put<int64_t>(time);
+	put<uint8_t>(static_cast<uint8_t>(dir));
+	put<uint8_t>(liType);
+	put<uint16_t>(static_cast<uint16_t>(len));
+	m_buf.insert(m_buf.end(), data, data + len);
+	m_records++;
+
+	if (time - m_flushed >= _TRACE_FLUSH_INTERVAL) {
+		this->flush();
+		m_flushed = time;
+	}
+}
+
+void TraceRecorder::flush() {
+	if (m_buf.empty() || !m_active)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_free.empty()) {
+		// Writer thread is behind: drop the buffer instead of blocking
+		m_dropped += m_records;
+	} else {
+		m_full.push_back(std::move(m_buf));
+		m_buf = std::move(m_free.back());
+		m_free.pop_back();
+		m_cond.notify_one();
+	}
+	m_buf.clear();
+	m_records = 0;
+}
+
+void TraceRecorder::writerLoop() {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true) {
+		m_cond.wait(lock, [this]() { return m_stop || !m_full.empty(); });
+		if (m_full.empty())
+			return; // stopped & everything written
+
+		Buffer buf = std::move(m_full.front());
+		m_full.pop_front();
+		lock.unlock();
+		m_file.write(reinterpret_cast<const char *>(buf.data()), static_cast<qint64>(buf.size()));
+		m_file.flush();
+		buf.clear();
+		lock.lock();
+		m_free.push_back(std::move(buf));
+	}
+}
+
+template <typename T>
+void TraceRecorder::put(T value) {
+	for (size_t i = 0; i < sizeof(T); i++)
+		m_buf.push_back(static_cast<uint8_t>(static_cast<uint64_t>(value) >> (8*i)));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+TraceReader::TraceReader(const QString &filename) {
+	QFile file(filename);
+	if (!file.open(QIODevice::ReadOnly))
+		throw ETraceError("Unable to open trace file "+filename+": "+file.errorString());
+	const QByteArray data = file.readAll();
+	m_data.assign(data.begin(), data.end());
+
+	if ((m_data.size() < _TRACE_HEADER_SIZE) ||
+	    !std::equal(std::begin(_TRACE_MAGIC), std::end(_TRACE_MAGIC), m_data.begin()))
+		throw ETraceError(filename+" is not a trace file!");
+	if (get<uint16_t>(4) != _TRACE_VERSION)
+		throw ETraceError("Unsupported trace version "+QString::number(get<uint16_t>(4))+"!");
+}
+
+bool TraceReader::next(TraceRecord &record) {
+	if (m_pos + _TRACE_RECORD_HEADER_SIZE > m_data.size())
+		return false;
+
+	const size_t len = get<uint16_t>(m_pos+10);
+	if (m_pos + _TRACE_RECORD_HEADER_SIZE + len > m_data.size())
+		return false; // truncated record (recording interrupted)
+
+	record.time = get<int64_t>(m_pos);
+	record.dir = static_cast<TraceDir>(m_data[m_pos+8]);
+	record.liType = m_data[m_pos+9];
+	const auto begin = m_data.begin() + static_cast<ptrdiff_t>(m_pos + _TRACE_RECORD_HEADER_SIZE);
+	record.data.assign(begin, begin + static_cast<ptrdiff_t>(len));
+	m_pos += _TRACE_RECORD_HEADER_SIZE + len;
+	return true;
+}
+
+template <typename T>
+T TraceReader::get(size_t pos) const {
+	uint64_t value = 0;
+	for (size_t i = 0; i < sizeof(T); i++)
+		value |= static_cast<uint64_t>(m_data[pos+i]) << (8*i);
+	return static_cast<T>(value);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+TraceReplay::TraceReplay(XpressNet &xn, const QString &filename, QObject *parent)
+    : QObject(parent), m_xn(xn), m_reader(filename) {
+	m_timer.setSingleShot(true);
+	QObject::connect(&m_timer, SIGNAL(timeout()), this, SLOT(timerTick()));
+}
+
+void TraceReplay::start(double speed) {
+	this->stop();
+	if (m_xn.connected())
+		throw ETraceError("Unable to replay trace while connected!");
+	m_speed = speed;
+	m_replayed = 0;
+	m_reader.rewind();
+
+	if (speed <= 0) {
+		TraceRecord record;
+		while (m_reader.next(record))
+			if (!this->feed(record))
+				break;
+		emit finished();
+		return;
+	}
+
+	m_hasNext = m_reader.next(m_next);
+	if (m_hasNext)
+		m_timer.start(0);
+	else
+		emit finished();
+}
+
+void TraceReplay::stop() {
+	m_timer.stop();
+	m_hasNext = false;
+}
+
+void TraceReplay::timerTick() {
+	if (!m_hasNext)
+		return;
+	if (!this->feed(m_next)) {
+		m_hasNext = false;
+		emit finished();
+		return;
+	}
+	const Timestamp previous = m_next.time;
+	m_hasNext = m_reader.next(m_next);
+	if (m_hasNext)
+		this->scheduleNext(previous);
+	else
+		emit finished();
+}
+
+void TraceReplay::scheduleNext(Timestamp previous) {
+	const Timestamp delay = static_cast<Timestamp>((m_next.time - previous) / m_speed);
+	m_timer.start((delay > 0) ? static_cast<int>(delay / 1000) : 0);
+}
+
+bool TraceReplay::feed(const TraceRecord &record) {
+	if (record.dir != TraceDir::Rx)
+		return true;
+	if (!m_xn.replayReceived(static_cast<LIType>(record.liType), record.data.data(), record.data.size()))
+		return false;
+	m_replayed++;
+	return true;
+}
+
+} // namespace Xn
@@ -0,0 +1,149 @@
+#ifndef XN_TRACE_H
+#define XN_TRACE_H
+
+/*
+This file defines binary trace of XpressNET communication.
+
+TraceRecorder appends every chunk of received data & every sent frame into
+a trace file. Records are collected in a preallocated buffer, which is
+handed to a writer thread when it gets full or once per _TRACE_FLUSH_INTERVAL
+& replaced by an empty one (of _TRACE_BUFFERS preallocated buffers). So
+recording costs just a memcpy on the hot path, the file is never touched
+from the thread XpressNet runs on (except open & close). When the writer
+falls behind & no empty buffer is left, the full buffer is dropped (see
+TraceRecorder::dropped); the file stays consistent, records are missing.
+
+File format (little endian):
+  header: "XNTR", uint16 version, uint16 reserved
+  record: int64 timestamp [us, monotonic], uint8 direction, uint8 LI type,
+          uint16 length, 'length' bytes of raw data (received data are
+          recorded before framing, sent frames including LI header)
+
+TraceReader reads records back, TraceReplay feeds received data of a trace
+to XpressNet (framing & parsing) at recorded or maximum speed.
+*/
+
+#include <QFile>
+#include <QObject>
+#include <QTimer>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "q-str-exception.h"
+#include "xn-clock.h"
+
+namespace Xn {
+
+constexpr size_t _TRACE_BUFFER_SIZE = 64*1024; // bytes
+constexpr size_t _TRACE_BUFFERS = 4; // filled by recorder or waiting for writer thread
+constexpr Timestamp _TRACE_FLUSH_INTERVAL = 1000000; // us
+constexpr uint16_t _TRACE_VERSION = 1;
+constexpr size_t _TRACE_HEADER_SIZE = 8;
+constexpr size_t _TRACE_RECORD_HEADER_SIZE = 12;
+
+struct ETraceError : public QStrException {
+	ETraceError(const QString str) : QStrException(str) {}
+};
+
+enum class TraceDir : uint8_t {
+	Rx = 0,
+	Tx = 1,
+};
+
+struct TraceRecord {
+	Timestamp time;
+	TraceDir dir;
+	uint8_t liType;
+	std::vector<uint8_t> data;
+};
+
+class TraceRecorder {
+public:
+	TraceRecorder();
+	~TraceRecorder();
+
+	void open(const QString &filename);
+	void close(); // waits for the writer thread to write all records
+	bool active() const { return m_active; }
+
+	void record(Timestamp time, TraceDir dir, uint8_t liType, const uint8_t *data, size_t len);
+	void flush(); // hands buffered records to the writer thread, does not wait
+	size_t dropped() const { return m_dropped; } // records lost, writer was behind
+
+private:
+	using Buffer = std::vector<uint8_t>;
+
+	QFile m_file; // used by the writer thread only while it runs
+	bool m_active = false;
+	Buffer m_buf; // being filled by 'record'
+	size_t m_records = 0; // in m_buf
+	size_t m_dropped = 0;
+	Timestamp m_flushed = 0;
+
+	std::thread m_writer;
+	std::mutex m_mutex; // guards members below
+	std::condition_variable m_cond;
+	std::deque<Buffer> m_full; // waiting for the writer thread
+	std::vector<Buffer> m_free; // written, ready for reuse
+	bool m_stop = false;
+
+	void writerLoop();
+	template <typename T>
+	void put(T value);
+};
+
+class TraceReader {
+public:
+	explicit TraceReader(const QString &filename);
+	bool next(TraceRecord &record); // false iff end of trace
+	void rewind() { m_pos = _TRACE_HEADER_SIZE; }
+
+private:
+	std::vector<uint8_t> m_data;
+	size_t m_pos = _TRACE_HEADER_SIZE;
+
+	template <typename T>
+	T get(size_t pos) const;
+};
+
+class XpressNet;
+
+class TraceReplay : public QObject {
+	Q_OBJECT
+
+public:
+	TraceReplay(XpressNet &xn, const QString &filename, QObject *parent = nullptr);
+
+	// speed: 1 = recorded speed, 2 = twice as fast, ..., 0 = maximum speed
+	// Maximum speed replay runs synchronously, 'finished' is emitted before return.
+	// Throws ETraceError when 'xn' is connected, replay stops when it connects.
+	void start(double speed = 1);
+	void stop();
+	size_t replayed() const { return m_replayed; } // number of received records fed
+
+signals:
+	void finished();
+
+private slots:
+	void timerTick();
+
+private:
+	XpressNet &m_xn;
+	TraceReader m_reader;
+	QTimer m_timer;
+	TraceRecord m_next;
+	bool m_hasNext = false;
+	double m_speed = 1;
+	size_t m_replayed = 0;
+
+	bool feed(const TraceRecord &record); // false iff refused by XpressNet
+	void scheduleNext(Timestamp previous);
+};
+
+} // namespace Xn
+
+#endif
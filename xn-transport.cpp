@@ -0,0 +1,286 @@
+#include <algorithm>
+
+#include "xn-transport.h"
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+/* Byte transports between XpressNet engine & LI. */
+
+namespace Xn {
+
+SerialTransport::SerialTransport(QObject *parent) : Transport(parent) {
+	QObject::connect(&m_port, SIGNAL(readyRead()), this, SIGNAL(readyRead()));
+	QObject::connect(&m_port, SIGNAL(bytesWritten(qint64)), this, SIGNAL(bytesWritten(qint64)));
+	QObject::connect(&m_port, SIGNAL(aboutToClose()), this, SIGNAL(aboutToClose()));
+	QObject::connect(&m_port, SIGNAL(errorOccurred(QSerialPort::SerialPortError)), this,
+	                 SLOT(portError(QSerialPort::SerialPortError)));
+}
+
+void SerialTransport::configure(const QString &portname, int32_t br, QSerialPort::FlowControl fc) {
+	m_port.setBaudRate(br);
+	m_port.setFlowControl(fc);
+	m_port.setPortName(portname);
+}
+
+bool SerialTransport::open() { return m_port.open(QIODevice::ReadWrite); }
+void SerialTransport::close() { m_port.close(); }
+
+qint64 SerialTransport::write(const uint8_t *data, size_t len) {
+	return m_port.write(reinterpret_cast<const char *>(data), static_cast<qint64>(len));
+}
+
+qint64 SerialTransport::read(uint8_t *data, size_t maxLen) {
+	return m_port.read(reinterpret_cast<char *>(data), static_cast<qint64>(maxLen));
+}
+
+void SerialTransport::portError(QSerialPort::SerialPortError serialPortError) {
+	if (serialPortError != QSerialPort::NoError)
+		emit error(m_port.errorString());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+LoopbackTransport::LoopbackTransport(QObject *parent) : Transport(parent) {
+	m_deliver.setSingleShot(true);
+	QObject::connect(&m_deliver, SIGNAL(timeout()), this, SLOT(deliver()));
+}
+
+bool LoopbackTransport::open() {
+	m_open = true;
+	m_rx.clear();
+	m_rxPos = 0;
+	return true;
+}
+
+void LoopbackTransport::close() {
+	if (!m_open)
+		return;
+	emit aboutToClose();
+	m_open = false;
+	m_deliver.stop();
+}
+
+qint64 LoopbackTransport::write(const uint8_t *data, size_t len) {
+	if (!m_open)
+		return -1;
+	if (onWrite != nullptr)
+		onWrite(data, len);
+	emit bytesWritten(static_cast<qint64>(len));
+	return static_cast<qint64>(len);
+}
+
+qint64 LoopbackTransport::read(uint8_t *data, size_t maxLen) {
+	const size_t len = std::min(maxLen, m_rx.size() - m_rxPos);
+	std::copy(m_rx.begin() + static_cast<ptrdiff_t>(m_rxPos),
+	          m_rx.begin() + static_cast<ptrdiff_t>(m_rxPos + len), data);
+	m_rxPos += len;
+	if (m_rxPos == m_rx.size()) {
+		m_rx.clear();
+		m_rxPos = 0;
+	}
+	return static_cast<qint64>(len);
+}
+
+void LoopbackTransport::inject(const uint8_t *data, size_t len) {
+	if (!m_open)
+		return;
+	m_rx.insert(m_rx.end(), data, data + len);
+	if (!m_deliver.isActive())
+		m_deliver.start(0);
+}
+
+void LoopbackTransport::injectNow(const uint8_t *data, size_t len) {
+	if (!m_open)
+		return;
+	m_rx.insert(m_rx.end(), data, data + len);
+	m_deliver.stop();
+	emit readyRead();
+}
+
+void LoopbackTransport::fail(const QString &message) {
+	emit error(message);
+}
+
+void LoopbackTransport::deliver() {
+	if (m_open && bytesAvailable() > 0)
+		emit readyRead();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+TcpTransport::TcpTransport(QObject *parent) : Transport(parent) {
+	QObject::connect(&m_socket, SIGNAL(readyRead()), this, SIGNAL(readyRead()));
+	QObject::connect(&m_socket, SIGNAL(bytesWritten(qint64)), this, SIGNAL(bytesWritten(qint64)));
+	QObject::connect(&m_socket, SIGNAL(aboutToClose()), this, SIGNAL(aboutToClose()));
+	QObject::connect(&m_socket, SIGNAL(connected()), this, SLOT(socketConnected()));
+	QObject::connect(&m_socket, SIGNAL(disconnected()), this, SLOT(socketDisconnected()));
+	QObject::connect(&m_socket, SIGNAL(errorOccurred(QAbstractSocket::SocketError)), this,
+	                 SLOT(socketError(QAbstractSocket::SocketError)));
+	m_connectTimer.setSingleShot(true);
+	QObject::connect(&m_connectTimer, SIGNAL(timeout()), this, SLOT(connectTimeout()));
+}
+
+void TcpTransport::configure(const QString &host, uint16_t port) {
+	m_host = host;
+	m_port = port;
+}
+
+bool TcpTransport::open() {
+	// Does not block the engine: connected() -> 'opened', errorOccurred() -> 'error'
+	m_failed = false;
+	m_opening = true;
+	m_socket.connectToHost(m_host, m_port);
+	m_opening = false;
+	if (m_socket.state() == QAbstractSocket::UnconnectedState)
+		return false; // failed immediately, see errorString
+	m_connectTimer.start(_TCP_CONNECT_TIMEOUT);
+	return true;
+}
+
+void TcpTransport::close() {
+	m_connectTimer.stop();
+	m_closing = true;
+	m_socket.close();
+	m_closing = false;
+}
+
+qint64 TcpTransport::write(const uint8_t *data, size_t len) {
+	return m_socket.write(reinterpret_cast<const char *>(data), static_cast<qint64>(len));
+}
+
+qint64 TcpTransport::read(uint8_t *data, size_t maxLen) {
+	return m_socket.read(reinterpret_cast<char *>(data), static_cast<qint64>(maxLen));
+}
+
+void TcpTransport::socketConnected() {
+	m_connectTimer.stop();
+	// Each frame should be sent immediately, frames are tiny
+	m_socket.setSocketOption(QAbstractSocket::LowDelayOption, 1);
+	emit opened();
+}
+
+void TcpTransport::socketError(QAbstractSocket::SocketError) {
+	m_connectTimer.stop();
+	if (!m_opening)
+		this->fail(m_socket.errorString());
+}
+
+void TcpTransport::connectTimeout() {
+	m_closing = true;
+	m_socket.abort();
+	m_closing = false;
+	this->fail("Connection to "+m_host+":"+QString::number(m_port)+" timed out");
+}
+
+void TcpTransport::socketDisconnected() {
+	this->fail("LI closed TCP connection");
+}
+
+void TcpTransport::fail(const QString &message) {
+	// Closed by LI: errorOccurred(RemoteHostClosedError) is followed by
+	// disconnected(), report the first one only
+	if (m_closing || m_failed)
+		return;
+	m_failed = true;
+	emit error(message);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef Q_OS_UNIX
+
+PtyTransport::PtyTransport(QObject *parent) : Transport(parent) {}
+
+PtyTransport::~PtyTransport() {
+	try {
+		this->close();
+	} catch (...) {
+		// No exceptions in destructor
+	}
+}
+
+bool PtyTransport::open() {
+	if (m_fd >= 0)
+		return true;
+
+	int fd = ::posix_openpt(O_RDWR | O_NOCTTY);
+	if ((fd < 0) || (::grantpt(fd) != 0) || (::unlockpt(fd) != 0)) {
+		m_error = QString("Unable to create pty: ") + std::strerror(errno);
+		if (fd >= 0)
+			::close(fd);
+		return false;
+	}
+
+	// Raw mode: no echo, no line discipline processing of binary data
+	struct termios tio;
+	if (::tcgetattr(fd, &tio) == 0) {
+		::cfmakeraw(&tio);
+		::tcsetattr(fd, TCSANOW, &tio);
+	}
+	::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	// Keep slave side open, so master does not hang up until simulator attaches
+	m_slavePath = QString(::ptsname(fd));
+	m_slaveFd = ::open(::ptsname(fd), O_RDWR | O_NOCTTY);
+	m_fd = fd;
+	m_notifier = std::make_unique<QSocketNotifier>(m_fd, QSocketNotifier::Read);
+	QObject::connect(m_notifier.get(), SIGNAL(activated(int)), this, SLOT(readable()));
+	return true;
+}
+
+void PtyTransport::close() {
+	if (m_fd < 0)
+		return;
+	emit aboutToClose();
+	m_notifier.reset();
+	if (m_slaveFd >= 0)
+		::close(m_slaveFd);
+	::close(m_fd);
+	m_fd = -1;
+	m_slaveFd = -1;
+	m_slavePath = "";
+}
+
+qint64 PtyTransport::write(const uint8_t *data, size_t len) {
+	if (m_fd < 0)
+		return -1;
+	const ssize_t written = ::write(m_fd, data, len);
+	if (written < 0) {
+		m_error = QString("pty write: ") + std::strerror(errno);
+		return -1;
+	}
+	emit bytesWritten(static_cast<qint64>(written));
+	return static_cast<qint64>(written);
+}
+
+qint64 PtyTransport::read(uint8_t *data, size_t maxLen) {
+	if (m_fd < 0)
+		return -1;
+	const ssize_t len = ::read(m_fd, data, maxLen);
+	if (len < 0)
+		return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+	return static_cast<qint64>(len);
+}
+
+qint64 PtyTransport::bytesAvailable() const {
+	int available = 0;
+	if ((m_fd < 0) || (::ioctl(m_fd, FIONREAD, &available) != 0))
+		return 0;
+	return available;
+}
+
+void PtyTransport::readable() {
+	if (this->bytesAvailable() > 0)
+		emit readyRead();
+}
+
+#endif
+
+} // namespace Xn
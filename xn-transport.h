@@ -0,0 +1,201 @@
+#ifndef XN_TRANSPORT_H
+#define XN_TRANSPORT_H
+
+/*
+This file defines byte transports between XpressNet engine & LI.
+
+Transport is an asynchronous byte stream: 'write' queues data & returns
+immediately ('bytesWritten' is emitted once data are handed over to the
+device), 'readyRead' is emitted when data could be read, 'error' when the
+device fails (transport is usually closed by the engine then). 'open' could
+be asynchronous too: it returns before the device is open & 'opened' or
+'error' is emitted later.
+
+Implementations:
+ * SerialTransport: LI connected via serial port (QSerialPort).
+ * LoopbackTransport: in-memory transport; written data are passed to
+   'onWrite' handler, data for the engine are injected by 'inject' ('injectNow'
+   without event loop). Allows to run the whole engine without any LI
+   (benchmarks, soak tests).
+ * TcpTransport: LI-USB-Ethernet connected directly via TCP (no virtual COM
+   port), Nagle's algorithm disabled. Connects asynchronously.
+ * PtyTransport (unix only): engine talks to master side of a pseudo
+   terminal, LI simulator attaches to 'slavePath()'.
+*/
+
+#include <QObject>
+#include <QSerialPort>
+#include <QSocketNotifier>
+#include <QTcpSocket>
+#include <QTimer>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace Xn {
+
+constexpr uint16_t _LI_ETH_TCP_PORT = 5550;
+constexpr int _TCP_CONNECT_TIMEOUT = 3000; // ms
+
+class Transport : public QObject {
+	Q_OBJECT
+
+public:
+	explicit Transport(QObject *parent = nullptr) : QObject(parent) {}
+
+	// false = error, see errorString; true & !isOpen() = 'opened' or 'error' follows
+	virtual bool open() = 0;
+	virtual void close() = 0; // emits aboutToClose iff open
+	virtual bool isOpen() const = 0;
+	virtual qint64 write(const uint8_t *data, size_t len) = 0; // -1 = error
+	virtual qint64 read(uint8_t *data, size_t maxLen) = 0;
+	virtual qint64 bytesAvailable() const = 0;
+	virtual QString errorString() const = 0;
+
+	virtual unsigned baudrate() const { return 0; } // 0 = no wire time (e.g. in-memory)
+	virtual void setReadBufferSize(size_t) {}
+
+signals:
+	void opened(); // asynchronous 'open' finished
+	void readyRead();
+	void bytesWritten(qint64 bytes);
+	void error(QString message);
+	void aboutToClose();
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+class SerialTransport : public Transport {
+	Q_OBJECT
+
+public:
+	explicit SerialTransport(QObject *parent = nullptr);
+	void configure(const QString &portname, int32_t br, QSerialPort::FlowControl fc);
+
+	bool open() override;
+	void close() override;
+	bool isOpen() const override { return m_port.isOpen(); }
+	qint64 write(const uint8_t *data, size_t len) override;
+	qint64 read(uint8_t *data, size_t maxLen) override;
+	qint64 bytesAvailable() const override { return m_port.bytesAvailable(); }
+	QString errorString() const override { return m_port.errorString(); }
+	unsigned baudrate() const override { return static_cast<unsigned>(m_port.baudRate()); }
+	void setReadBufferSize(size_t size) override {
+		m_port.setReadBufferSize(static_cast<qint64>(size));
+	}
+
+private slots:
+	void portError(QSerialPort::SerialPortError);
+
+private:
+	QSerialPort m_port;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+class LoopbackTransport : public Transport {
+	Q_OBJECT
+
+public:
+	using WriteHandler = std::function<void(const uint8_t *data, size_t len)>;
+
+	explicit LoopbackTransport(QObject *parent = nullptr);
+
+	bool open() override;
+	void close() override;
+	bool isOpen() const override { return m_open; }
+	qint64 write(const uint8_t *data, size_t len) override;
+	qint64 read(uint8_t *data, size_t maxLen) override;
+	qint64 bytesAvailable() const override { return static_cast<qint64>(m_rx.size() - m_rxPos); }
+	QString errorString() const override { return m_open ? "" : "Loopback closed"; }
+
+	WriteHandler onWrite; // called synchronously for each write
+	void inject(const uint8_t *data, size_t len); // 'readyRead' is emitted asynchronously
+	void injectNow(const uint8_t *data, size_t len); // 'readyRead' emitted before return
+	void fail(const QString &message); // simulates device error
+
+private slots:
+	void deliver();
+
+private:
+	bool m_open = false;
+	std::vector<uint8_t> m_rx;
+	size_t m_rxPos = 0;
+	QTimer m_deliver;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+class TcpTransport : public Transport {
+	Q_OBJECT
+
+public:
+	explicit TcpTransport(QObject *parent = nullptr);
+	void configure(const QString &host, uint16_t port = _LI_ETH_TCP_PORT);
+
+	bool open() override; // asynchronous, 'opened' or 'error' within _TCP_CONNECT_TIMEOUT
+	void close() override;
+	bool isOpen() const override { return m_socket.state() == QAbstractSocket::ConnectedState; }
+	qint64 write(const uint8_t *data, size_t len) override;
+	qint64 read(uint8_t *data, size_t maxLen) override;
+	qint64 bytesAvailable() const override { return m_socket.bytesAvailable(); }
+	QString errorString() const override { return m_socket.errorString(); }
+	void setReadBufferSize(size_t size) override {
+		m_socket.setReadBufferSize(static_cast<qint64>(size));
+	}
+
+private slots:
+	void socketConnected();
+	void socketError(QAbstractSocket::SocketError);
+	void socketDisconnected();
+	void connectTimeout();
+
+private:
+	QTcpSocket m_socket;
+	QTimer m_connectTimer;
+	QString m_host;
+	uint16_t m_port = _LI_ETH_TCP_PORT;
+	bool m_closing = false;
+	bool m_opening = false; // inside connectToHost: errors are returned by open
+	bool m_failed = false; // error of this connection already reported
+
+	void fail(const QString &message);
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+#ifdef Q_OS_UNIX
+
+class PtyTransport : public Transport {
+	Q_OBJECT
+
+public:
+	explicit PtyTransport(QObject *parent = nullptr);
+	~PtyTransport() override;
+
+	bool open() override;
+	void close() override;
+	bool isOpen() const override { return m_fd >= 0; }
+	qint64 write(const uint8_t *data, size_t len) override;
+	qint64 read(uint8_t *data, size_t maxLen) override;
+	qint64 bytesAvailable() const override;
+	QString errorString() const override { return m_error; }
+
+	QString slavePath() const { return m_slavePath; } // valid when open
+
+private slots:
+	void readable();
+
+private:
+	int m_fd = -1; // master
+	int m_slaveFd = -1;
+	QString m_slavePath;
+	QString m_error;
+	std::unique_ptr<QSocketNotifier> m_notifier;
+};
+
+#endif
+
+} // namespace Xn
+
+#endif
@@ -8,24 +8,24 @@
 
 namespace Xn {
 
-XpressNet::XpressNet(QObject *parent) : QObject(parent) {
-	m_serialPort.setReadBufferSize(256);
-	m_lastSent = QDateTime::currentDateTime();
-
-	QObject::connect(&m_serialPort, SIGNAL(readyRead()), this, SLOT(handleReadyRead()));
-	QObject::connect(&m_serialPort, SIGNAL(errorOccurred(QSerialPort::SerialPortError)), this,
-	                 SLOT(handleError(QSerialPort::SerialPortError)));
+XpressNet::XpressNet(QObject *parent)
+    : QObject(parent), m_pending_timer(this), m_out_timer(this), m_feedback_timer(this) {
+	// Timers are children, so they move with XpressNet to engine thread (xn-engine-thread.h)
+	m_clock = &m_steadyClock;
+	m_lastSent = now();
 
+	m_pending_timer.setSingleShot(true);
 	QObject::connect(&m_pending_timer, SIGNAL(timeout()), this, SLOT(m_pending_timer_tick()));
 	m_out_timer.setInterval(m_config.outInterval);
 	QObject::connect(&m_out_timer, SIGNAL(timeout()), this, SLOT(m_out_timer_tick()));
-	QObject::connect(&m_serialPort, SIGNAL(aboutToClose()), this, SLOT(sp_about_to_close()));
+	m_feedback_timer.setSingleShot(true);
+	QObject::connect(&m_feedback_timer, SIGNAL(timeout()), this, SLOT(m_feedback_timer_tick()));
 }
 
 XpressNet::~XpressNet() {
 	try {
-		if (m_serialPort.isOpen())
-			m_serialPort.close();
+		if (this->connected() || m_connecting)
+			m_transport->close();
 	}  catch (...) {
 		// No exceptions in destructor
 	}
@@ -35,28 +35,43 @@ void XpressNet::sp_about_to_close() {
 	m_pending_timer.stop();
 	m_out_timer.stop();
 	while (!m_pending.empty()) {
+		bump(m_metrics.cmd(m_pending.front().type).errors);
 		if (nullptr != m_pending.front().callback_err)
 			m_pending.front().callback_err->func(this, m_pending.front().callback_err->data);
 		m_pending.pop_front();
 	}
+	m_deadlines.clear();
+	m_trace.flush();
 	while (!m_out.empty()) {
-		if (nullptr != m_out.front().callback_err)
-			m_out.front().callback_err->func(this, m_out.front().callback_err->data);
-		m_out.pop_front();
+		PendingItem out = m_out.take();
+		bump(m_metrics.cmd(out.type).errors);
+		if (nullptr != out.callback_err)
+			out.callback_err->func(this, out.callback_err->data);
 	}
 	m_trk_status = TrkStatus::Unknown;
+	m_locos.clear(); // locos could be controlled by others while we are disconnected
+	this->feedback_flush();
+	m_feedback.clear();
+	this->metrics_gauges();
 
 	log("Disconnected", LogLevel::Info);
 }
 
 void XpressNet::log(const QString &message, const LogLevel loglevel) {
-	if (loglevel <= this->loglevel)
+	if (logged(loglevel))
 		emit onLog(message, loglevel);
 }
 
-void XpressNet::handleError(QSerialPort::SerialPortError serialPortError) {
-	if (serialPortError != QSerialPort::NoError)
-		emit onError(m_serialPort.errorString());
+void XpressNet::handleError(QString message) {
+	if (m_connecting) {
+		// Asynchronous open failed: not connected, nothing to disconnect
+		m_connecting = false;
+		m_transport->close();
+		log("Connect error: " + message, LogLevel::Error);
+		emit onConnectError(message);
+		return;
+	}
+	emit onError(message);
 }
 
 QString XpressNet::xnReadCVStatusToQString(const ReadCVStatus st) {
@@ -126,6 +141,10 @@ std::vector<QSerialPortInfo> XpressNet::ports(LIType litype) {
 #endif
 }
 
+size_t XpressNet::outDepth(CmdPriority prio) const {
+	return m_out.depth(prio);
+}
+
 XNConfig XpressNet::config() const {
 	return m_config;
 }
@@ -134,8 +153,125 @@ void XpressNet::setConfig(const XNConfig config) {
 	if ((config.outInterval < _OUT_TIMER_INTERVAL_MIN) || (config.outInterval > _OUT_TIMER_INTERVAL_MAX))
 		throw EInvalidConfig("outInterval="+QString::number(config.outInterval)+" is out of range ["+
 		      QString::number(_OUT_TIMER_INTERVAL_MIN)+"-"+QString::number(_OUT_TIMER_INTERVAL_MAX)+"]");
+	if (config.pendingMax > _PENDING_MAX_LIMIT)
+		throw EInvalidConfig("pendingMax="+QString::number(config.pendingMax)+" is out of range [0-"+
+		      QString::number(_PENDING_MAX_LIMIT)+"]");
+	if (config.readBufferSize > _READ_BUFFER_SIZE_MAX)
+		throw EInvalidConfig("readBufferSize="+QString::number(config.readBufferSize)+" is out of range [0-"+
+		      QString::number(_READ_BUFFER_SIZE_MAX)+"]");
+	if (config.pacingBurst > _PACING_BURST_MAX)
+		throw EInvalidConfig("pacingBurst="+QString::number(config.pacingBurst)+" is out of range [0-"+
+		      QString::number(_PACING_BURST_MAX)+"]");
+	if (config.feedbackWindow > _FEEDBACK_WINDOW_MAX)
+		throw EInvalidConfig("feedbackWindow="+QString::number(config.feedbackWindow)+" is out of range [0-"+
+		      QString::number(_FEEDBACK_WINDOW_MAX)+"]");
 	m_config = config;
+	this->feedback_flush(); // changes in the window of the old config
 	m_out_timer.setInterval(m_config.outInterval);
+	if (m_transport != nullptr)
+		m_transport->setReadBufferSize(m_config.readBufferSize);
+	this->pacer_configure();
+}
+
+void XpressNet::pacer_configure() {
+	m_pacer.configure((m_transport != nullptr) ? m_transport->baudrate() : 0, pendingWindow(),
+	                  static_cast<Timestamp>(m_config.pacingBurst)*1000,
+	                  static_cast<Timestamp>(m_config.outInterval*pendingWindow())*1000);
+	this->metrics_pacing();
+}
+
+ReceiveStats XpressNet::receiveStats() const { return m_framer.stats(); }
+
+void XpressNet::metrics_gauges() {
+	EngineMetrics &engine = m_metrics.engine();
+	for (size_t i = 0; i < _CMD_PRIORITY_COUNT; i++)
+		engine.outDepth[i].store(m_out.depth(static_cast<CmdPriority>(i)), std::memory_order_relaxed);
+	engine.inFlight.store(m_pending.size(), std::memory_order_relaxed);
+}
+
+void XpressNet::metrics_pacing() {
+	EngineMetrics &engine = m_metrics.engine();
+	engine.avgRtt.store(static_cast<uint64_t>(std::max<Timestamp>(m_pacer.rtt(), 0)),
+	                    std::memory_order_relaxed);
+
+	double rate; // frames per second
+	if (m_config.pacing == PacingMode::Adaptive)
+		rate = m_pacer.rate(wireBytes(CmdSetSpeedDir(1, 0, Direction::Forward)));
+	else
+		rate = 1000.0 / m_config.outInterval;
+	engine.pacingRate.store(static_cast<uint64_t>(rate * 1000), std::memory_order_relaxed);
+}
+
+void XpressNet::metricsReset() {
+	m_metrics.reset();
+	m_framer.stats() = ReceiveStats();
+	m_metrics.receive().update(m_framer.stats());
+}
+
+void XpressNet::traceStart(const QString &filename) {
+	m_trace.open(filename);
+	log("Tracing to "+filename, LogLevel::Info);
+}
+
+void XpressNet::traceStop() {
+	if (m_trace.active())
+		log("Tracing stopped", LogLevel::Info);
+	m_trace.close();
+}
+
+bool XpressNet::tracing() const { return m_trace.active(); }
+
+size_t XpressNet::pendingWindow() const {
+	if (m_config.pendingMax > 0)
+		return m_config.pendingMax;
+	return (m_liType == LIType::LIUSBEth) ? _PENDING_MAX_AT_ONCE_ETH : _PENDING_MAX_AT_ONCE;
+}
+
+void XpressNet::setTimeSource(const TimeSource *clock) {
+	m_clock = (clock != nullptr) ? clock : &m_steadyClock;
+	m_lastSent = now();
+}
+
+PacingMode pacingMode(const QString &name) {
+	if (name == "adaptive")
+		return PacingMode::Adaptive;
+	return PacingMode::Fixed;
+}
+
+QString pacingModeName(PacingMode mode) {
+	if (mode == PacingMode::Adaptive)
+		return "adaptive";
+	return "fixed";
+}
+
+LocoCachePolicy locoCachePolicy(const QString &name) {
+	if (name == "untilStolen")
+		return LocoCachePolicy::UntilStolen;
+	if (name == "maxAge")
+		return LocoCachePolicy::MaxAge;
+	return LocoCachePolicy::Off;
+}
+
+QString locoCachePolicyName(LocoCachePolicy policy) {
+	if (policy == LocoCachePolicy::UntilStolen)
+		return "untilStolen";
+	if (policy == LocoCachePolicy::MaxAge)
+		return "maxAge";
+	return "off";
+}
+
+const LocoState *XpressNet::locoCached(LocoAddr addr, uint8_t parts) const {
+	if (m_config.locoCache == LocoCachePolicy::Off)
+		return nullptr;
+	const LocoState &state = m_locos[addr];
+	if ((!state.has(parts)) || (state.has(LocoState::Used) && state.used))
+		return nullptr; // other device could change the loco without notifying us
+	const bool untilStolen = (m_config.locoCache == LocoCachePolicy::UntilStolen) &&
+	                         state.controlled; // stolen loco is invalidated
+	if ((!untilStolen) &&
+	    (now() - state.updated > msToTimestamp(static_cast<int64_t>(m_config.locoCacheMaxAge))))
+		return nullptr;
+	return &state;
 }
 
 QString XpressNet::liVersionToStr(unsigned version)
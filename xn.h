@@ -19,41 +19,84 @@ How does sending work?
       is sent again. Iff the command station does not reply for _PENDING_SEND_MAX
       times, 'error' callback is called.
 
+ * Commands waiting for sending are queued in lanes by their priority (see
+   CmdPriority): emergency stops & track power are sent before loco control,
+   accessory operations and queries. Queued speed commands superseded by
+   an emergency stop are removed from the queue; they call 'superseded'
+   callback ('error' callback when no 'superseded' callback is given).
+ * When coalescing is enabled (XNConfig::coalesce), a speed or function
+   command queued & not sent yet is replaced by a newer command for the same
+   loco & function group. Replaced command calls 'superseded' callback instead
+   of 'ok' and 'error' callbacks ('ok' callback is called when no 'superseded'
+   callback is given).
+ * State of locos (speed, direction, functions) is cached (see xn-loco-cache.h).
+   When XNConfig::locoCache allows it, 'getLocoInfo' & 'getLocoFunc1328' call
+   their callback from the cache immediately instead of asking the command
+   station.
+ * 'acquireLocos' queries state of many locos at once. Only one information &
+   one function 13-28 query could be in flight (their replies carry no loco
+   address), so information of one loco is pipelined with functions of
+   another: acquisition takes about one round trip per loco instead of two,
+   results are reported as they come.
+ * State of feedback inputs is kept in a table (see xn-feedback.h),
+   'onAccInputChanged' is emitted only when state of the nibble really
+   changes (or when it is reply to 'accInfoRequest'). 'onAccInputsChanged'
+   reports the same changes in batches (see XNConfig::feedbackWindow).
  * Response to the user`s command is transmitted to the user as callback.
  * General callbacks are implemented as slots (see below).
  * For adding more commands, see xn-typedefs.h.
 */
 
-#include <QDateTime>
 #include <QObject>
 #include <QSerialPort>
 #include <QSerialPortInfo>
 #include <QTimer>
+#include <algorithm>
 #include <memory>
 #include <queue>
 #include <vector>
 
 #include "q-str-exception.h"
+#include "xn-clock.h"
 #include "xn-commands.h"
+#include "xn-feedback.h"
+#include "xn-frame.h"
+#include "xn-framer.h"
 #include "xn-loco-addr.h"
+#include "xn-loco-cache.h"
+#include "xn-metrics.h"
+#include "xn-pacer.h"
+#include "xn-queue.h"
+#include "xn-trace.h"
+#include "xn-transport.h"
 
 #define XN_VERSION_MAJOR 2
 #define XN_VERSION_MINOR 8
 
 namespace Xn {
 
-constexpr size_t _PENDING_CHECK_INTERVAL = 100; // ms
 constexpr size_t _PENDING_TIMEOUT = 1000; // ms
 constexpr size_t _PENDING_PROG_TIMEOUT = 10000; // 10 s
 constexpr size_t _PENDING_SEND_MAX = 3; // how many times to send the command till error
-constexpr size_t _PENDING_MAX_AT_ONCE = 3; // how many commands could be pending at once
+constexpr size_t _PENDING_MAX_AT_ONCE = 3; // how many commands could be pending at once (default)
+constexpr size_t _PENDING_MAX_AT_ONCE_ETH = 8; // default for LI-USB-Ethernet
+constexpr size_t _PENDING_MAX_LIMIT = 16;
 constexpr size_t _BUF_IN_TIMEOUT = 300; // ms
+constexpr size_t _READ_BUFFER_SIZE_DEFAULT = 256; // bytes, 0 = unlimited
+constexpr size_t _READ_BUFFER_SIZE_MAX = 65536;
 constexpr size_t _STEPS_CNT = 28;
 
 constexpr size_t _OUT_TIMER_INTERVAL_DEFAULT = 50; // ms
 constexpr size_t _OUT_TIMER_INTERVAL_MIN = 50; // ms
 constexpr size_t _OUT_TIMER_INTERVAL_MAX = 500; // ms
 
+constexpr size_t _PACING_BURST_DEFAULT = 100; // ms
+constexpr size_t _PACING_BURST_MAX = 2000; // ms
+
+constexpr size_t _LOCO_CACHE_MAX_AGE_DEFAULT = 10000; // ms
+
+constexpr size_t _FEEDBACK_WINDOW_MAX = 1000; // ms
+
 struct EOpenError : public QStrException {
 	EOpenError(const QString str) : QStrException(str) {}
 };
@@ -87,43 +130,6 @@ enum class TrkStatus {
 	Programming = 3,
 };
 
-using CommandCallbackFunc = std::function<void(void *sender, void *data)>;
-
-struct CommandCallback {
-	CommandCallbackFunc const func;
-	void *const data;
-
-	CommandCallback(CommandCallbackFunc const func, void *const data = nullptr)
-	    : func(func), data(data) {}
-};
-
-using Cb = CommandCallback;
-using UPCb = std::unique_ptr<CommandCallback>;
-
-// PendingItem represents a command sent to the LI, for which the response
-// has not arrived yet.
-struct PendingItem {
-	PendingItem(std::unique_ptr<const Cmd> &cmd, QDateTime timeout, size_t no_sent,
-	            std::unique_ptr<Cb> &&callback_ok, std::unique_ptr<Cb> &&callback_err)
-	    : cmd(std::move(cmd))
-	    , timeout(timeout)
-	    , no_sent(no_sent)
-	    , callback_ok(std::move(callback_ok))
-	    , callback_err(std::move(callback_err)) {}
-	PendingItem(PendingItem &&pending) noexcept
-	    : cmd(std::move(pending.cmd))
-	    , timeout(pending.timeout)
-	    , no_sent(pending.no_sent)
-	    , callback_ok(std::move(pending.callback_ok))
-	    , callback_err(std::move(pending.callback_err)) {}
-
-	std::unique_ptr<const Cmd> cmd;
-	QDateTime timeout;
-	size_t no_sent;
-	std::unique_ptr<Cb> callback_ok;
-	std::unique_ptr<Cb> callback_err;
-};
-
 enum class LogLevel {
 	None = 0,
 	Error = 1,
@@ -134,22 +140,11 @@ enum class LogLevel {
 	Debug = 6,
 };
 
-enum class FeedbackType {
-	accWithoutFb = 0,
-	accWithFb = 1,
-	fb = 2,
-	reserved = 3,
-};
-
-union AccInputsState {
-	uint8_t all;
-	struct {
-		bool i0 : 1;
-		bool i1 : 1;
-		bool i2 : 1;
-		bool i3 : 1;
-	} sep;
-};
+// Messages with higher log level are compiled out (see xn_log_lean in xn.pro).
+#ifndef XN_LOG_MAX_LEVEL
+#define XN_LOG_MAX_LEVEL 6
+#endif
+constexpr LogLevel _LOG_MAX_LEVEL = static_cast<LogLevel>(XN_LOG_MAX_LEVEL);
 
 enum class RecvCmdType {
 	LiError = 0x01,
@@ -164,8 +159,38 @@ enum class RecvCmdType {
 	CsAccInfoResp = 0x42,
 };
 
+enum class PacingMode {
+	Fixed, // one frame per outInterval
+	Adaptive, // token bucket by bytes on the wire & measured response time, see xn-pacer.h
+};
+
+PacingMode pacingMode(const QString &name);
+QString pacingModeName(PacingMode mode);
+
+enum class LocoCachePolicy {
+	Off, // always ask the command station
+	UntilStolen, // state of loco we control is valid until stolen or disconnect, others as MaxAge
+	MaxAge, // cached state is valid for XNConfig::locoCacheMaxAge since the last update
+};
+
+LocoCachePolicy locoCachePolicy(const QString &name);
+QString locoCachePolicyName(LocoCachePolicy policy);
+
+// Bulk loco acquire, see XpressNet::acquireLocos
+using GotLoco = std::function<void(void *sender, LocoAddr, const LocoState &)>;
+using LocoNotAcquired = std::function<void(void *sender, LocoAddr)>;
+using LocosAcquired = std::function<void(void *sender, size_t acquired, size_t failed)>;
+
 struct XNConfig {
 	size_t outInterval = _OUT_TIMER_INTERVAL_DEFAULT;
+	PacingMode pacing = PacingMode::Fixed;
+	size_t pacingBurst = _PACING_BURST_DEFAULT; // ms
+	size_t pendingMax = 0; // commands in flight at once, 0 = default for the LI type
+	size_t readBufferSize = _READ_BUFFER_SIZE_DEFAULT; // serial port read buffer
+	bool coalesce = false; // replace queued speed & function commands by newer ones
+	LocoCachePolicy locoCache = LocoCachePolicy::Off; // answering loco state queries from cache
+	size_t locoCacheMaxAge = _LOCO_CACHE_MAX_AGE_DEFAULT; // ms, for LocoCachePolicy::MaxAge
+	size_t feedbackWindow = 0; // ms, batches of onAccInputsChanged, 0 = per received frame
 };
 
 class XpressNet : public QObject {
@@ -180,8 +205,12 @@ public:
 	~XpressNet() override;
 
 	void connect(const QString &portname, int32_t br, QSerialPort::FlowControl fc, LIType liType);
-	void disconnect();
+	// Asynchronous: 'onConnect' or 'onConnectError' follows
+	void connectTcp(const QString &host, uint16_t port = _LI_ETH_TCP_PORT); // LI-USB-Ethernet
+	void connect(std::unique_ptr<Transport>, LIType liType); // e.g. LoopbackTransport
+	void disconnect(); // cancels connecting too
 	bool connected() const;
+	bool connecting() const { return m_connecting; } // asynchronous transport is opening
 
 	TrkStatus getTrkStatus() const;
 
@@ -202,13 +231,23 @@ public:
 	void writeCVdirect(uint8_t cv, uint8_t value, UPCb ok = nullptr, UPCb err = nullptr);
 
 	void setSpeed(LocoAddr, uint8_t speed, Direction direction, UPCb ok = nullptr,
-	              UPCb err = nullptr);
+	              UPCb err = nullptr, UPCb superseded = nullptr);
 	void getLocoInfo(LocoAddr, GotLocoInfo const &, UPCb err = nullptr);
 	void getLocoFunc1328(LocoAddr, GotLocoFunc1328, UPCb err = nullptr);
-	void setFuncA(LocoAddr, FA, UPCb ok = nullptr, UPCb err = nullptr);
-	void setFuncB(LocoAddr, FB, FSet, UPCb ok = nullptr, UPCb err = nullptr);
-	void setFuncC(LocoAddr, FC, UPCb ok = nullptr, UPCb err = nullptr);
-	void setFuncD(LocoAddr, FD, UPCb ok = nullptr, UPCb err = nullptr);
+	// Information & functions 13-28 of each loco: 'acquired' or 'failed' is called for
+	// each loco as soon as its queries finish, 'done' once after all locos.
+	// Two queries are in flight at once (see isLocoQuery), cached locos are answered
+	// immediately.
+	void acquireLocos(const std::vector<LocoAddr> &, GotLoco const &acquired,
+	                  LocoNotAcquired const &failed = nullptr, LocosAcquired const &done = nullptr);
+	void setFuncA(LocoAddr, FA, UPCb ok = nullptr, UPCb err = nullptr,
+	              UPCb superseded = nullptr);
+	void setFuncB(LocoAddr, FB, FSet, UPCb ok = nullptr, UPCb err = nullptr,
+	              UPCb superseded = nullptr);
+	void setFuncC(LocoAddr, FC, UPCb ok = nullptr, UPCb err = nullptr,
+	              UPCb superseded = nullptr);
+	void setFuncD(LocoAddr, FD, UPCb ok = nullptr, UPCb err = nullptr,
+	              UPCb superseded = nullptr);
 
 	void accInfoRequest(uint8_t groupAddr, bool nibble, UPCb err = nullptr);
 	void accOpRequest(uint16_t portAddr, bool state, // portAddr 0-2047
@@ -223,66 +262,133 @@ public:
 
 	XNConfig config() const;
 	void setConfig(XNConfig config);
+	// Replaces the engine's clock, e.g. by VirtualClock; nullptr = steady clock.
+	// 'clock' must outlive this object.
+	void setTimeSource(const TimeSource *clock);
+
+	size_t outDepth(CmdPriority) const; // number of commands waiting in lane of outgoing queue
+	size_t pendingWindow() const; // effective number of commands in flight at once
+	ReceiveStats receiveStats() const;
+	// Any thread: per-command-type counters & latency histograms, see xn-metrics.h
+	const Metrics &metrics() const { return m_metrics; }
+	void metricsReset();
+	// Cached state of the loco if it has all 'parts' (see LocoState::Part) & the
+	// cache policy allows to use it, nullptr otherwise
+	const LocoState *locoCached(LocoAddr, uint8_t parts = LocoState::ALL) const;
+	// Any thread: state of all feedback inputs as last reported by the command station
+	const FeedbackTable &feedback() const { return m_feedback; }
+
+	// Binary trace of all received data & sent frames, see xn-trace.h
+	void traceStart(const QString &filename);
+	void traceStop();
+	bool tracing() const;
+	// Feeds data to the framer & parser as if they were received (trace replay).
+	// Refused (returns false) while connected: replay switches LI type & framing.
+	bool replayReceived(LIType liType, const uint8_t *data, size_t len);
 
 private slots:
 	void handleReadyRead();
-	void handleError(QSerialPort::SerialPortError);
+	void handleError(QString message);
+	void handleOpened();
 	void m_pending_timer_tick();
 	void m_out_timer_tick();
+	void m_feedback_timer_tick();
 	void sp_about_to_close();
 
 signals:
 	void onError(QString error);
 	void onLog(QString message, Xn::LogLevel loglevel);
 	void onConnect();
+	void onConnectError(QString error); // asynchronous connect failed, transport closed
 	void onDisconnect();
 	void onTrkStatusChanged(Xn::TrkStatus);
 	void onLocoStolen(Xn::LocoAddr);
 	void onAccInputChanged(uint8_t groupAddr, bool nibble, bool error, Xn::FeedbackType inputType,
 	                       Xn::AccInputsState state);
+	void onAccInputsChanged(Xn::AccInputChanges changes);
 
 private:
-	QSerialPort m_serialPort;
-	QByteArray m_readData;
-	QDateTime m_receiveTimeout;
-	QDateTime m_lastSent;
-	std::deque<PendingItem> m_pending; // commands sent to CS with no response yet
-	std::deque<PendingItem> m_out; // commands not sent to CS yet
+	std::unique_ptr<Transport> m_transport;
+	bool m_connecting = false;
+	Framer m_framer;
+	bool m_xorResync = false; // skipping bytes after XOR error, already logged
+	TraceRecorder m_trace;
+	SteadyClock m_steadyClock;
+	const TimeSource *m_clock;
+	Timestamp m_receiveTimeout = 0;
+	Timestamp m_lastSent;
+	Pacer m_pacer;
+	CmdQueue m_pending; // commands sent to CS with no response yet
+	DeadlineHeap m_deadlines; // timeouts of m_pending items
+	uint64_t m_pending_seq = 0;
+	OutQueue m_out; // commands not sent to CS yet
 	QTimer m_pending_timer;
 	QTimer m_out_timer;
+	QTimer m_feedback_timer; // end of feedback coalescing window
+	AccInputChanges m_feedback_changes; // not reported by onAccInputsChanged yet
 	TrkStatus m_trk_status = TrkStatus::Unknown;
 	LIType m_liType;
 	XNConfig m_config;
-
-	using MsgType = std::vector<uint8_t>;
-	void parseMessage(MsgType &msg);
-	void send(MsgType);
+	Metrics m_metrics;
+	LocoCache m_locos;
+	FeedbackTable m_feedback;
+
+	using MsgType = MsgView;
+	void parseFrames();
+	void parseMessage(const MsgType &msg);
+	void send(Frame);
 	void send(std::unique_ptr<const Cmd>, UPCb ok = nullptr, UPCb err = nullptr,
-	          size_t no_sent = 1);
+	          size_t no_sent = 1, UPCb superseded = nullptr);
 	void to_send(PendingItem &&, bool bypass_m_out_emptiness = false);
 	void to_send(std::unique_ptr<const Cmd> &, UPCb ok = nullptr, UPCb err = nullptr,
-	             size_t no_sent = 1, bool bypass_m_out_emptiness = false);
+	             size_t no_sent = 1, bool bypass_m_out_emptiness = false,
+	             UPCb superseded = nullptr);
+	bool coalesce(std::unique_ptr<const Cmd> &, UPCb &ok, UPCb &err, UPCb &superseded);
+	void out_push(PendingItem &&);
+	size_t sendDelay(const Cmd &);
+	void out_timer_start(size_t delay);
+	void pacer_configure();
+	size_t wireBytes(const Cmd &) const;
+	Timestamp now() const { return m_clock->now(); }
+	void call_superseded(PendingItem &);
+	void call_dropped(PendingItem &);
 
 	template <typename T>
-	void to_send(const T &&cmd, UPCb ok = nullptr, UPCb err = nullptr);
-
-	void handleMsgLiError(MsgType &msg);
-	void handleMsgLiVersion(MsgType &msg);
-	void handleMsgCsGeneralEvent(MsgType &msg);
-	void handleMsgCsStatus(MsgType &msg);
-	void handleMsgCsVersion(MsgType &msg);
-	void handleMsgCvRead(MsgType &msg);
-	void handleMsgLocoInfo(MsgType &msg);
-	void handleMsgLocoFunc(MsgType &msg);
-	void handleMsgLIAddr(MsgType &msg);
-	void handleMsgAcc(MsgType &msg);
+	void to_send(const T &&cmd, UPCb ok = nullptr, UPCb err = nullptr,
+	             UPCb superseded = nullptr);
+
+	void handleMsgLiError(const MsgType &msg);
+	void handleMsgLiVersion(const MsgType &msg);
+	void handleMsgCsGeneralEvent(const MsgType &msg);
+	void handleMsgCsStatus(const MsgType &msg);
+	void handleMsgCsVersion(const MsgType &msg);
+	void handleMsgCvRead(const MsgType &msg);
+	void handleMsgLocoInfo(const MsgType &msg);
+	void handleMsgLocoFunc(const MsgType &msg);
+	void handleMsgLIAddr(const MsgType &msg);
+	void handleMsgAcc(const MsgType &msg);
+	void feedback_flush();
 
 	void pending_ok();
+	void pending_ok(CmdQueue::iterator);
 	void pending_err(bool _log = true);
-	void pending_send();
+	void pending_err(CmdQueue::iterator, bool _log = true);
+	void pending_send(CmdQueue::iterator);
+	void pending_push(std::unique_ptr<const Cmd> &cmd, size_t no_sent, UPCb &&ok, UPCb &&err,
+	                  UPCb &&superseded);
+	void pending_removed();
+	void metrics_gauges(); // refreshes queue depths in m_metrics
+	void metrics_pacing(); // refreshes pacing rate & response time in m_metrics
+	void pending_timer_arm();
 	void send_next_out();
+	bool logged(LogLevel loglevel) const {
+		return (loglevel <= _LOG_MAX_LEVEL) && (loglevel <= this->loglevel);
+	}
 	void log(const QString &message, LogLevel loglevel);
-	QDateTime timeout(const Cmd *x);
+	// Lazy variant: 'message' closure is called only when 'loglevel' is logged.
+	template <typename F>
+	void log(LogLevel loglevel, F message);
+	Timestamp timeout(const Cmd *x) const;
 	bool liAcknowledgesSetAccState() const;
 	bool conflictWithPending(const Cmd &) const;
 	bool conflictWithOut(const Cmd &) const;
@@ -293,14 +399,29 @@ private:
 
 	template <typename Target>
 	bool is(const PendingItem &h);
+
+	// Response correlation: a response belongs to the oldest pending command
+	// matching it, not necessarily to the head of the pending buffer.
+	template <typename Pred>
+	CmdQueue::iterator pending_find_if(Pred pred);
+	template <typename Target, typename Pred>
+	CmdQueue::iterator pending_find(Pred match);
+	template <typename Target>
+	CmdQueue::iterator pending_find();
 };
 
 // Templated functions must be in header file to compile
 
 template <typename T>
-void XpressNet::to_send(const T &&cmd, UPCb ok, UPCb err) {
+void XpressNet::to_send(const T &&cmd, UPCb ok, UPCb err, UPCb superseded) {
 	std::unique_ptr<const Cmd> cmd2(std::make_unique<const T>(cmd));
-	to_send(cmd2, std::move(ok), std::move(err));
+	to_send(cmd2, std::move(ok), std::move(err), 1, false, std::move(superseded));
+}
+
+template <typename F>
+void XpressNet::log(LogLevel loglevel, F message) {
+	if (logged(loglevel))
+		emit onLog(message(), loglevel);
 }
 
 template <typename DataT, typename ItemType>
@@ -315,7 +436,24 @@ QString XpressNet::dataToStr(DataT data, size_t len) {
 
 template <typename Target>
 bool XpressNet::is(const PendingItem &h) {
-	return (dynamic_cast<const Target *>(h.cmd.get()) != nullptr);
+	return Xn::is<Target>(*(h.cmd));
+}
+
+template <typename Pred>
+CmdQueue::iterator XpressNet::pending_find_if(Pred pred) {
+	return std::find_if(m_pending.begin(), m_pending.end(), pred);
+}
+
+template <typename Target, typename Pred>
+CmdQueue::iterator XpressNet::pending_find(Pred match) {
+	return pending_find_if([&match](const PendingItem &item) {
+		return Xn::is<Target>(*(item.cmd)) && match(as<Target>(*(item.cmd)));
+	});
+}
+
+template <typename Target>
+CmdQueue::iterator XpressNet::pending_find() {
+	return pending_find_if([](const PendingItem &item) { return Xn::is<Target>(*(item.cmd)); });
 }
 
 QString flowControlToStr(QSerialPort::FlowControl);
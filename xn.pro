@@ -9,11 +9,26 @@ SOURCES += \
 	xn-receive.cpp \
 	xn-send.cpp \
 	xn-pending.cpp \
+	xn-trace.cpp \
+	xn-transport.cpp \
+	xn-engine-thread.cpp \
 	xn-win-com-discover.cpp
 HEADERS += \
 	xn.h \
 	xn-loco-addr.h \
+	xn-loco-cache.h \
+	xn-feedback.h \
 	xn-commands.h \
+	xn-frame.h \
+	xn-queue.h \
+	xn-pacer.h \
+	xn-metrics.h \
+	xn-clock.h \
+	xn-framer.h \
+	xn-trace.h \
+	xn-transport.h \
+	xn-lockfree.h \
+	xn-engine-thread.h \
 	q-str-exception.h \
 	xn-win-com-discover.h
 
@@ -36,6 +51,11 @@ FORMS += config-window.ui
 CONFIG += c++14 dll
 QMAKE_CXXFLAGS += -Wall -Wextra -pedantic
 
+# qmake CONFIG+=xn_log_lean: compile out Commands, RawData & Debug log messages
+xn_log_lean {
+	DEFINES += XN_LOG_MAX_LEVEL=3
+}
+
 win32 {
 	QMAKE_LFLAGS += -Wl,--kill-at
 	QMAKE_CXXFLAGS += -enable-stdcall-fixup
@@ -47,7 +67,7 @@ win64 {
 	LIBS += -lsetupapi
 }
 
-QT += core gui serialport
+QT += core gui serialport network
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 VERSION_MAJOR = 2